@@ -0,0 +1,75 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_BENCHMARK_H
+#define EMD_BENCHMARK_H
+
+#include <functional>
+#include <stdint.h>
+
+#include <QList>
+#include <QString>
+
+namespace emd
+{
+
+struct BenchmarkResult
+{
+    QString name;
+    int64_t iterations;
+    double nsecsPerIteration;
+    // Pixels processed per second, summed over every frame of an iteration
+    double pixelRate;
+};
+
+// Times kernels and keeps the results so that they can be saved as JSON and
+// compared against an earlier run.
+class Benchmark
+{
+public:
+    Benchmark();
+
+    // Only benchmarks whose name contains the filter are run.
+    void setFilter(const QString &filter);
+    void setMinimumTime(int msecs);
+
+    // Calls body repeatedly until the minimum time has passed. Each call is
+    // taken to process pixelCount pixels.
+    void run(const QString &name, int64_t pixelCount, const std::function<void()> &body);
+
+    const QList<BenchmarkResult> &results() const;
+
+    bool save(const QString &path) const;
+
+    // Prints each result next to the matching one in a saved run. Returns
+    // the number of benchmarks whose pixel rate dropped by more than
+    // tolerance (a fraction of the baseline rate), or -1 if the file
+    // couldn't be read.
+    int compare(const QString &path, double tolerance) const;
+
+private:
+    QString m_filter;
+    int m_minimumTime;
+    QList<BenchmarkResult> m_results;
+};
+
+} // namespace emd
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Benchmark.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QTextStream>
+
+namespace emd
+{
+
+static const int kDefaultMinimumTime = 200;   // In milliseconds
+
+Benchmark::Benchmark()
+    : m_minimumTime(kDefaultMinimumTime)
+{
+}
+
+void Benchmark::setFilter(const QString &filter)
+{
+    m_filter = filter;
+}
+
+void Benchmark::setMinimumTime(int msecs)
+{
+    m_minimumTime = msecs;
+}
+
+void Benchmark::run(const QString &name, int64_t pixelCount, const std::function<void()> &body)
+{
+    if(!m_filter.isEmpty() && !name.contains(m_filter))
+        return;
+
+    // Warm up the caches and any lazily built tables
+    body();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    int64_t iterations = 0;
+    int64_t minimumTime = (int64_t) m_minimumTime * 1000000;
+
+    do
+    {
+        body();
+        ++iterations;
+    }
+    while(timer.nsecsElapsed() < minimumTime);
+
+    BenchmarkResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsecsPerIteration = (double) timer.nsecsElapsed() / iterations;
+    result.pixelRate = pixelCount * 1e9 / result.nsecsPerIteration;
+
+    m_results.append(result);
+
+    QTextStream out(stdout);
+    out << qSetFieldWidth(48) << left << name << reset
+        << QString::number(result.nsecsPerIteration * 1e-3, 'f', 1) << " us  "
+        << QString::number(result.pixelRate * 1e-6, 'f', 1) << " Mpixel/s\n";
+}
+
+const QList<BenchmarkResult> &Benchmark::results() const
+{
+    return m_results;
+}
+
+bool Benchmark::save(const QString &path) const
+{
+    QJsonArray results;
+
+    for(const BenchmarkResult &result : m_results)
+    {
+        QJsonObject object;
+        object["name"] = result.name;
+        object["iterations"] = (double) result.iterations;
+        object["nsecsPerIteration"] = result.nsecsPerIteration;
+        object["pixelRate"] = result.pixelRate;
+
+        results.append(object);
+    }
+
+    QJsonObject root;
+    root["benchmarks"] = results;
+
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly))
+    {
+        qCritical() << "Failed to open benchmark file: " << path;
+        return false;
+    }
+
+    file.write(QJsonDocument(root).toJson());
+
+    return true;
+}
+
+int Benchmark::compare(const QString &path, double tolerance) const
+{
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly))
+    {
+        qCritical() << "Failed to open baseline file: " << path;
+        return -1;
+    }
+
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+    if(!document.isObject())
+    {
+        qCritical() << "Invalid baseline file: " << path;
+        return -1;
+    }
+
+    QMap<QString, double> baseline;
+
+    QJsonArray results = document.object()["benchmarks"].toArray();
+    for(const QJsonValue &value : results)
+    {
+        QJsonObject object = value.toObject();
+        baseline[object["name"].toString()] = object["pixelRate"].toDouble();
+    }
+
+    int regressions = 0;
+
+    QTextStream out(stdout);
+    out << "\nComparison with " << path << "\n";
+
+    for(const BenchmarkResult &result : m_results)
+    {
+        out << qSetFieldWidth(48) << left << result.name << reset;
+
+        if(!baseline.contains(result.name) || baseline[result.name] <= 0.)
+        {
+            out << "new\n";
+            continue;
+        }
+
+        double ratio = result.pixelRate / baseline[result.name];
+
+        out << (ratio >= 1. ? "+" : "") << QString::number((ratio - 1.) * 100., 'f', 1) << "%";
+
+        if(ratio < 1. - tolerance)
+        {
+            out << "  REGRESSION";
+            ++regressions;
+        }
+
+        out << "\n";
+    }
+
+    return regressions;
+}
+
+} // namespace emd
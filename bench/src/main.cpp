@@ -0,0 +1,546 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+#include <QLibrary>
+#include <QPluginLoader>
+
+#include "Benchmark.h"
+#include "BinaryOutputModule.h"
+#include "ComplexModule.h"
+#include "DataGroup.h"
+#include "DatasetStorage.h"
+#include "FileManager.h"
+#include "Frame.h"
+#include "FrameCache.h"
+#include "HistogramModule.h"
+#include "ImageWindowModule.h"
+#include "Model.h"
+#include "PixelKernels.h"
+#include "Plugin.h"
+#include "ProcessingContext.h"
+#include "Util.h"
+
+using namespace emd;
+
+static const QString kProgramName = "emd_bench";
+static const QString kCompanyName = "MesoBine";
+
+// Frames summed per integration step
+static const int kIntegrationFrameCount = 8;
+
+static const int s_supportedTypeCount = 10;
+static const DataType s_types[s_supportedTypeCount] =
+{
+    DataTypeUInt8,
+    DataTypeUInt16,
+    DataTypeUInt32,
+    DataTypeUInt64,
+    DataTypeInt8,
+    DataTypeInt16,
+    DataTypeInt32,
+    DataTypeInt64,
+    DataTypeFloat32,
+    DataTypeFloat64
+};
+
+static const char *s_complexTypeNames[ComplexTypeCount] =
+{
+    "Real",
+    "Imaginary",
+    "Phase",
+    "Amplitude",
+    "Intensity",
+    "UnwrappedPhase"
+};
+
+/******************************** Synthetic Data **********************************/
+
+template <typename T>
+static void fillData(T *data, int64_t size, uint32_t seed)
+{
+    // A fixed generator keeps the data, and so any data-dependent branches,
+    // the same from run to run.
+    for(int64_t iii = 0; iii < size; ++iii)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        data[iii] = (T) (seed >> 24);
+    }
+}
+
+template <typename T>
+static Frame *createFrame(DataType type, int size, bool columnMajor, bool complex, uint32_t seed)
+{
+    int64_t length = (int64_t) size * size;
+
+    T *real = new T[length];
+    fillData(real, length, seed);
+
+    T *imaginary = nullptr;
+    if(complex)
+    {
+        imaginary = new T[length];
+        fillData(imaginary, length, ~seed);
+    }
+
+    int hStep = columnMajor ? size : 1;
+    int vStep = columnMajor ? 1 : size;
+
+    return new Frame(real, imaginary, hStep, vStep, size, size, type);
+}
+
+static Frame *createFrame(DataType type, int size, bool columnMajor, bool complex,
+                          uint32_t seed = 1)
+{
+    switch(type)
+    {
+    case DataTypeInt8:
+        return createFrame<int8_t>(type, size, columnMajor, complex, seed);
+    case DataTypeInt16:
+        return createFrame<int16_t>(type, size, columnMajor, complex, seed);
+    case DataTypeInt32:
+        return createFrame<int32_t>(type, size, columnMajor, complex, seed);
+    case DataTypeInt64:
+        return createFrame<int64_t>(type, size, columnMajor, complex, seed);
+    case DataTypeUInt8:
+        return createFrame<uint8_t>(type, size, columnMajor, complex, seed);
+    case DataTypeUInt16:
+        return createFrame<uint16_t>(type, size, columnMajor, complex, seed);
+    case DataTypeUInt32:
+        return createFrame<uint32_t>(type, size, columnMajor, complex, seed);
+    case DataTypeUInt64:
+        return createFrame<uint64_t>(type, size, columnMajor, complex, seed);
+    case DataTypeFloat32:
+        return createFrame<float>(type, size, columnMajor, complex, seed);
+    case DataTypeFloat64:
+        return createFrame<double>(type, size, columnMajor, complex, seed);
+    default:
+        break;
+    }
+
+    return nullptr;
+}
+
+// Frames [first, first + count) of a one dimensional selection, so that two
+// contexts with different first frames overlap the way a moving slider does.
+static ProcessingContext createContext(DataType type, int size, bool columnMajor,
+                                       int first, int count)
+{
+    FrameSet::Selection selection(count);
+    selection[0].start = first;
+
+    ProcessingContext context;
+    context.init(selection);
+
+    for(int index = 0; index < count; ++index)
+    {
+        context.setFrameAtIndex(createFrame(type, size, columnMajor, false, first + index + 1),
+                                index);
+    }
+
+    return context;
+}
+
+/******************************** Benchmarks **********************************/
+
+static void benchmarkCoreModules(Benchmark &bench, DataType type, int size, bool columnMajor)
+{
+    QString suffix = QString("/%1/%2/%3").arg(emdTypeString(type)).arg(size)
+        .arg(columnMajor ? "column" : "row");
+    int64_t pixelCount = (int64_t) size * size;
+
+    std::shared_ptr<Frame> frame(createFrame(type, size, columnMajor, false));
+    std::shared_ptr<Frame> complexFrame(createFrame(type, size, columnMajor, true));
+
+    ComplexModule complex;
+    for(int complexType = 0; complexType < ComplexTypeCount; ++complexType)
+    {
+        complex.setComplexType(complexType);
+
+        bench.run(QString("Complex/") + s_complexTypeNames[complexType] + suffix, pixelCount, [&]()
+        {
+            complex.processSharedFrame(complexFrame, 0);
+        });
+    }
+
+    ImageWindowModule imageWindow;
+    bench.run("ImageWindow" + suffix, pixelCount, [&]()
+    {
+        imageWindow.processSharedFrame(frame, 0);
+        imageWindow.discardResults();
+    });
+
+    HistogramModule histogram;
+    histogram.setHistogramSize(256, 128);
+    QObject::connect(&histogram, &HistogramModule::histogramGenerated,
+        [](QImage *image, float, float) { delete image; });
+
+    bench.run("Histogram" + suffix, pixelCount, [&]()
+    {
+        histogram.processSharedFrame(frame, 0);
+    });
+
+    BinaryOutputModule binaryOutput;
+    binaryOutput.setScalingLimits(QVariant(0.f), QVariant(1.f));
+
+    for(int processingMode = BinaryOutputModule::ProcessingModeTruncate;
+        processingMode <= BinaryOutputModule::ProcessingModeScale;
+        ++processingMode)
+    {
+        binaryOutput.setProcessingMode((BinaryOutputModule::ProcessingMode) processingMode);
+
+        QString modeName = processingMode == BinaryOutputModule::ProcessingModeTruncate
+            ? "Truncate" : "Scale";
+
+        for(int index = 0; index < s_supportedTypeCount; ++index)
+        {
+            binaryOutput.setOutputType(s_types[index]);
+
+            bench.run(QString("BinaryOutput/%1/%2%3").arg(modeName).arg(emdTypeString(s_types[index]))
+                .arg(suffix), pixelCount, [&]()
+            {
+                binaryOutput.processSharedFrame(frame, 0);
+            });
+        }
+    }
+}
+
+static void benchmarkPluginModules(Benchmark &bench, DataType type, int size, bool columnMajor)
+{
+    QString suffix = QString("/%1/%2/%3").arg(emdTypeString(type)).arg(size)
+        .arg(columnMajor ? "column" : "row");
+    int64_t pixelCount = (int64_t) size * size;
+
+    WorkflowModule *fourierTransform = WorkflowModule::create("FourierTransform", "FourierTransform");
+    if(fourierTransform)
+    {
+        std::shared_ptr<Frame> complexFrame(createFrame(type, size, columnMajor, true));
+
+        fourierTransform->setProperty("DataShift", true);
+
+        const char *transformTypes[] = { "Forward", "Reverse" };
+        for(const char *transformType : transformTypes)
+        {
+            fourierTransform->setProperty("TransformType", transformType);
+            fourierTransform->preprocess();
+
+            bench.run(QString("FourierTransform/") + transformType + suffix, pixelCount, [&]()
+            {
+                fourierTransform->processSharedFrame(complexFrame, 0);
+            });
+        }
+
+        delete fourierTransform;
+    }
+
+    WorkflowModule *integration = WorkflowModule::create("Core", "Integration");
+    if(integration)
+    {
+        ComplexModule source;
+        integration->addInput(&source);
+
+        ProcessingContext first = createContext(type, size, columnMajor, 0, kIntegrationFrameCount);
+        ProcessingContext second = createContext(type, size, columnMajor, kIntegrationFrameCount,
+                                                 kIntegrationFrameCount);
+
+        // A fresh sum of every frame
+        bench.run("Integration/Add" + suffix, pixelCount * kIntegrationFrameCount, [&]()
+        {
+            integration->reset();
+            integration->setInputContext(first, &source);
+            integration->preprocess();
+
+            for(int index = 0; index < kIntegrationFrameCount; ++index)
+                integration->processSharedFrame(first.sharedFrameAtIndex(index), index);
+        });
+
+        // Moving the selection to a disjoint range adds every new frame and
+        // subtracts every old one.
+        bool forward = true;
+        bench.run("Integration/AddSubtract" + suffix, 2 * pixelCount * kIntegrationFrameCount, [&]()
+        {
+            const ProcessingContext &next = forward ? second : first;
+            const ProcessingContext &last = forward ? first : second;
+
+            integration->setInputContext(next, &source);
+            integration->preprocess();
+
+            for(int index = 0; index < kIntegrationFrameCount; ++index)
+                integration->processSharedFrame(next.sharedFrameAtIndex(index), index);
+
+            for(int index = 0; index < kIntegrationFrameCount; ++index)
+                integration->processSharedFrame(last.sharedFrameAtIndex(index), kIntegrationFrameCount + index);
+
+            forward = !forward;
+        });
+
+        integration->removeInput(&source);
+        delete integration;
+    }
+}
+
+// Reads frames along the first free dimension of the data group's default
+// slice, with the frame cache disabled so that every read goes to the file.
+// The reads are timed with the default HDF5 chunk cache and again after it
+// has been tuned.
+static bool benchmarkReads(Benchmark &bench, const QString &path, int dataGroupIndex,
+                           int frameCount)
+{
+    Model model;
+
+    if(FileManager::openFile(path.toUtf8(), &model) != FileManager::ErrorNone)
+    {
+        qCritical() << "Failed to open file: " << path;
+        return false;
+    }
+
+    model.setFilePath(path);
+    model.validateDataGroups();
+
+    if(dataGroupIndex < 0 || dataGroupIndex >= model.dataGroupCount()
+       || !model.loadDataGroup(dataGroupIndex))
+    {
+        qCritical() << "Failed to load data group at index: " << dataGroupIndex;
+        return false;
+    }
+
+    DataGroup *dataGroup = model.dataGroupAtIndex(dataGroupIndex);
+    const Dataset *dataset = dataGroup->data();
+
+    DatasetStorage::attach(dataGroup);
+
+    Dataset::Slice slice = dataset->defaultSlice();
+
+    int dimension = -1;
+    for(int index = 0; index < (int) slice.size(); ++index)
+    {
+        if(slice[index] >= 0 && dataGroup->dimData(index)->dimLength(0) > 1)
+        {
+            dimension = index;
+            break;
+        }
+    }
+
+    if(dimension < 0)
+    {
+        qCritical() << "The data group has no free dimension to read along.";
+        return false;
+    }
+
+    std::vector<Dataset::Slice> slices;
+    int64_t length = dataGroup->dimData(dimension)->dimLength(0);
+
+    for(int64_t index = 0; index < std::min<int64_t>(frameCount, length); ++index)
+    {
+        slice[dimension] = index;
+        slices.push_back(slice);
+    }
+
+    FrameCache &cache = FrameCache::instance();
+    int64_t budget = cache.budget();
+    cache.setBudget(0);
+
+    std::vector<std::shared_ptr<Frame>> frames;
+    cache.frames(dataset, slices, frames, WorkflowModule::PriorityInteractive);
+
+    bool success = (frames.size() > 0 && frames[0]);
+
+    if(success)
+    {
+        int64_t pixelCount = (int64_t) slices.size() * frames[0]->data<void>().size();
+        int64_t bytes = (int64_t) slices.size() * FrameCache::frameBytes(frames[0].get());
+
+        auto read = [&]() {
+            cache.frames(dataset, slices, frames, WorkflowModule::PriorityInteractive);
+        };
+
+        QString name = QString("Read/%1/%2").arg(QFileInfo(path).fileName());
+
+        bench.run(name.arg("DefaultChunkCache"), pixelCount, read);
+
+        if(cache.tuneChunkCache(dataGroup) > 0)
+            bench.run(name.arg("TunedChunkCache"), pixelCount, read);
+        else
+            qWarning() << "The chunk cache could not be tuned for this dataset.";
+
+        for(const BenchmarkResult &result : bench.results())
+        {
+            if(result.name.startsWith(name.arg("")))
+            {
+                qDebug() << QString("%1: %2 MB/s").arg(result.name)
+                    .arg(bytes / (result.nsecsPerIteration * 1e-9) / (1024. * 1024.), 0, 'f', 1);
+            }
+        }
+    }
+    else
+    {
+        qCritical() << "Failed to read from data group at index: " << dataGroupIndex;
+    }
+
+    cache.remove(dataset);
+    cache.setBudget(budget);
+
+    return success;
+}
+
+static void loadPlugins()
+{
+    QDir pluginsDir = QDir(QCoreApplication::applicationDirPath());
+    if(!pluginsDir.cd("plugins"))
+    {
+        qWarning() << "Failed to locate plugin directory. Plugin modules won't be measured.";
+        return;
+    }
+
+    QStringList files = pluginsDir.entryList(QDir::Files);
+
+    for(const QString &fileName : files)
+    {
+        QString path = pluginsDir.absoluteFilePath(fileName);
+
+        if(!QLibrary::isLibrary(path))
+            continue;
+
+        QPluginLoader loader(path);
+        Plugin *plugin = qobject_cast<Plugin*>(loader.instance());
+
+        if(plugin)
+            plugin->declareModules();
+        else
+            qWarning() << "Could not load plugin: " << fileName;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QCoreApplication::setOrganizationName(kCompanyName);
+    QCoreApplication::setApplicationName(kProgramName);
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the throughput of the frame processing kernels.");
+    parser.addHelpOption();
+
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+        "Write the results to a JSON file.", "file");
+    QCommandLineOption baselineOption(QStringList() << "b" << "baseline",
+        "Compare the results against an earlier JSON file.", "file");
+    QCommandLineOption toleranceOption("tolerance",
+        "Slowdown, as a fraction of the baseline, reported as a regression.", "fraction", "0.1");
+    QCommandLineOption filterOption(QStringList() << "f" << "filter",
+        "Only run benchmarks whose name contains the text.", "text");
+    QCommandLineOption sizeOption(QStringList() << "s" << "sizes",
+        "Comma separated frame edge lengths.", "sizes", "256,2048");
+    QCommandLineOption timeOption(QStringList() << "t" << "min-time",
+        "Minimum time spent on each benchmark.", "msecs", "200");
+    QCommandLineOption fileOption("file",
+        "Measure reads from an EMD file instead of the processing kernels.", "file");
+    QCommandLineOption groupOption("group",
+        "Data group index for --file.", "index", "0");
+    QCommandLineOption framesOption("frames",
+        "Number of frames to read for --file.", "count", "64");
+    QCommandLineOption isaOption("isa",
+        "Widest instruction set for the pixel kernels: scalar, sse2, avx2 or avx512.", "name");
+
+    parser.addOption(outputOption);
+    parser.addOption(baselineOption);
+    parser.addOption(toleranceOption);
+    parser.addOption(filterOption);
+    parser.addOption(sizeOption);
+    parser.addOption(timeOption);
+    parser.addOption(fileOption);
+    parser.addOption(groupOption);
+    parser.addOption(framesOption);
+    parser.addOption(isaOption);
+
+    parser.process(app);
+
+    // Read when the kernels are first used
+    if(parser.isSet(isaOption))
+        qputenv("EMD_KERNEL_ISA", parser.value(isaOption).toLatin1());
+
+    qDebug() << "Pixel kernels:" << pixelKernelInstructionSet();
+
+    loadPlugins();
+
+    Benchmark bench;
+    bench.setFilter(parser.value(filterOption));
+    bench.setMinimumTime(parser.value(timeOption).toInt());
+
+    if(parser.isSet(fileOption))
+    {
+        if(!benchmarkReads(bench, parser.value(fileOption), parser.value(groupOption).toInt(),
+                           parser.value(framesOption).toInt()))
+            return 2;
+    }
+    else
+    {
+        QStringList sizes = parser.value(sizeOption).split(',', QString::SkipEmptyParts);
+
+        for(const QString &sizeText : sizes)
+        {
+            int size = sizeText.toInt();
+            if(size <= 0)
+            {
+                qCritical() << "Invalid frame size: " << sizeText;
+                return 2;
+            }
+
+            for(int index = 0; index < s_supportedTypeCount; ++index)
+            {
+                for(int columnMajor = 0; columnMajor < 2; ++columnMajor)
+                {
+                    benchmarkCoreModules(bench, s_types[index], size, columnMajor != 0);
+                    benchmarkPluginModules(bench, s_types[index], size, columnMajor != 0);
+                }
+            }
+        }
+    }
+
+    if(parser.isSet(outputOption) && !bench.save(parser.value(outputOption)))
+        return 2;
+
+    if(parser.isSet(baselineOption))
+    {
+        int regressions = bench.compare(parser.value(baselineOption),
+                                        parser.value(toleranceOption).toDouble());
+
+        if(regressions < 0)
+            return 2;
+
+        if(regressions > 0)
+            return 1;
+    }
+
+    return 0;
+}
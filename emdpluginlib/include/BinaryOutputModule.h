@@ -63,14 +63,15 @@ public:
     void setOutputType(DataType type);
 
     // WorkflowModule
+    virtual ConcurrencyMode concurrencyMode() const;
+    virtual WorkPriority workPriority() const;
+    virtual FrameLayout inputLayout() const;
+    virtual bool cancellable() const;
     virtual void postprocess();
 	virtual Frame *processFrame(Frame *frame, int index);
 
 	virtual void doWork(WorkContext *context);
 
-	template <typename T>
-	Frame *processData(Frame *frame);
-
     template <typename T, typename U>
 	Frame *processData(Frame *frame);
 
@@ -78,6 +79,16 @@ signals:
     void frameProcessed(Frame *frame);
 
 private:
+    // Converts from the frame's type, T, to the output type, U
+    template <typename T, typename U>
+    struct OutputKernel
+    {
+        static Frame *run(BinaryOutputModule *module, Frame *frame)
+        {
+            return module->processData<T, U>(frame);
+        }
+    };
+
     OutputMode m_outputMode;
     ProcessingMode m_processingMode;
     DataType m_dataType;
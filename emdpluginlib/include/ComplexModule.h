@@ -52,12 +52,16 @@ public:
 	// WorkflowModule
 	QWidget *controlWidget() override;
     void setInputContext(ProcessingContext context, WorkflowModule *previous) override;
+    ConcurrencyMode concurrencyMode() const override;
+    FrameLayout inputLayout() const override;
 	Frame *processFrame(Frame *frame, int index) override;
 
 public slots:
 	void setComplexType(int);
 
 private:
+	template <typename> friend struct ProcessDataKernel;
+
 	template <typename T>
 	Frame *processData(Frame *frame);
 
@@ -42,6 +42,14 @@ class EMDPLUGIN_API DataGroupModule : public WorkflowModule
 
     EMD_MODULE_DECLARATION
 
+public:
+    // Selections whose frames take more than this many bytes are streamed
+    // in windows, each run holding a part of the selection. The limit is
+    // taken from the "Preferences/StreamingLimit" setting, in MB. A limit
+    // of zero disables streaming.
+    static int64_t streamingLimit();
+    static void setStreamingLimit(int64_t bytes);
+
 public:
 	DataGroupModule(const DataGroup *dataGroup);
 	~DataGroupModule();
@@ -52,10 +60,16 @@ public:
 	void preprocess() override;
     void process() override;
     void postprocess() override;
+    bool hasNextRun() const override;
+    void doWork(WorkContext *context) override;
 
 private:
     const DataGroup *dataGroup() const;
 
+    // Splits the current selection into windows which fit the streaming
+    // limit.
+    void planWindows(const FrameSet::Selection &selection);
+
 public slots:
     void setSlice(const Dataset::Slice &slice);
     void setSelection(const FrameSet::Selection &selection);
@@ -65,6 +79,12 @@ protected:
     FrameSet::Selection m_selection;
     // TODO: find a better way
     FrameSet::Selection::SelectionIterator *m_selectionIterator;
+    int m_windowIndex;
+    int m_windowCount;
+    int m_windowFrames;
+
+    // The dataset of the current run, for the workers
+    const Dataset *m_dataset;
 };
 
 } // namespace emd
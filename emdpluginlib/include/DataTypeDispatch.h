@@ -0,0 +1,148 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_DATATYPEDISPATCH_H
+#define EMD_DATATYPEDISPATCH_H
+
+#include <stdint.h>
+#include <utility>
+
+#include "Frame.h"
+
+namespace emd
+{
+
+// Maps a C++ sample type to its DataType.
+template <typename T> struct DataTypeOf;
+
+template <> struct DataTypeOf<int8_t>   { static const DataType value = DataTypeInt8; };
+template <> struct DataTypeOf<int16_t>  { static const DataType value = DataTypeInt16; };
+template <> struct DataTypeOf<int32_t>  { static const DataType value = DataTypeInt32; };
+template <> struct DataTypeOf<int64_t>  { static const DataType value = DataTypeInt64; };
+template <> struct DataTypeOf<uint8_t>  { static const DataType value = DataTypeUInt8; };
+template <> struct DataTypeOf<uint16_t> { static const DataType value = DataTypeUInt16; };
+template <> struct DataTypeOf<uint32_t> { static const DataType value = DataTypeUInt32; };
+template <> struct DataTypeOf<uint64_t> { static const DataType value = DataTypeUInt64; };
+template <> struct DataTypeOf<float>    { static const DataType value = DataTypeFloat32; };
+template <> struct DataTypeOf<double>   { static const DataType value = DataTypeFloat64; };
+
+// Calls Kernel<T>::run(args...), with T the sample type of 'type', and
+// returns its result. A kernel is a class template with a static run()
+// whose return type doesn't depend on T:
+//
+//     template <typename T>
+//     struct ScaleKernel
+//     {
+//         static void run(Frame *frame, float factor);
+//     };
+//
+//     dispatchDataType<ScaleKernel>(frame->dataType(), frame, 2.f);
+//
+// Types the kernel should handle differently are explicit specialisations
+// of it; every other type falls through to the generic template. Types with
+// no sample type (strings, boxes) return a value-initialised result.
+template <template <typename> class Kernel, typename... Args>
+auto dispatchDataType(DataType type, Args &&... args)
+    -> decltype(Kernel<float>::run(std::forward<Args>(args)...))
+{
+    typedef decltype(Kernel<float>::run(std::forward<Args>(args)...)) Result;
+
+    switch(type)
+    {
+    case DataTypeInt8:
+        return Kernel<int8_t>::run(std::forward<Args>(args)...);
+    case DataTypeInt16:
+        return Kernel<int16_t>::run(std::forward<Args>(args)...);
+    case DataTypeInt32:
+        return Kernel<int32_t>::run(std::forward<Args>(args)...);
+    case DataTypeInt64:
+        return Kernel<int64_t>::run(std::forward<Args>(args)...);
+    case DataTypeUInt8:
+        return Kernel<uint8_t>::run(std::forward<Args>(args)...);
+    case DataTypeUInt16:
+        return Kernel<uint16_t>::run(std::forward<Args>(args)...);
+    case DataTypeUInt32:
+        return Kernel<uint32_t>::run(std::forward<Args>(args)...);
+    case DataTypeUInt64:
+        return Kernel<uint64_t>::run(std::forward<Args>(args)...);
+    case DataTypeFloat32:
+        return Kernel<float>::run(std::forward<Args>(args)...);
+    case DataTypeFloat64:
+        return Kernel<double>::run(std::forward<Args>(args)...);
+    default:
+        break;
+    }
+
+    return Result();
+}
+
+namespace detail
+{
+
+// Fixes the input type of a two-type kernel and dispatches on the output type
+template <template <typename, typename> class Kernel>
+struct OutputDispatch
+{
+    template <typename T>
+    struct Bound
+    {
+        template <typename U>
+        using Output = Kernel<T, U>;
+
+        template <typename... Args>
+        static auto run(DataType outputType, Args &&... args)
+            -> decltype(Kernel<T, float>::run(std::forward<Args>(args)...))
+        {
+            return dispatchDataType<Output>(outputType, std::forward<Args>(args)...);
+        }
+    };
+};
+
+} // namespace detail
+
+// Calls Kernel<T, U>::run(args...), with T the sample type of 'inputType'
+// and U that of 'outputType', for conversions between any two types.
+template <template <typename, typename> class Kernel, typename... Args>
+auto dispatchDataTypes(DataType inputType, DataType outputType, Args &&... args)
+    -> decltype(Kernel<float, float>::run(std::forward<Args>(args)...))
+{
+    return dispatchDataType<detail::OutputDispatch<Kernel>::template Bound>(
+                inputType, outputType, std::forward<Args>(args)...);
+}
+
+// Kernel that forwards to a module's processData<T>(). Modules that keep
+// processData() private befriend it:
+//
+//     template <typename> friend struct ProcessDataKernel;
+//
+//     return dispatchDataType<ProcessDataKernel>(frame->dataType(), this, frame);
+template <typename T>
+struct ProcessDataKernel
+{
+    template <typename Module, typename... Args>
+    static Frame *run(Module *module, Args &&... args)
+    {
+        return module->template processData<T>(std::forward<Args>(args)...);
+    }
+};
+
+} // namespace emd
+
+#endif
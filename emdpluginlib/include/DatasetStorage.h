@@ -0,0 +1,61 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_DATASETSTORAGE_H
+#define EMD_DATASETSTORAGE_H
+
+#include "EmdPluginLib.h"
+
+namespace emd
+{
+
+class DataGroup;
+class Dataset;
+
+// Looks up how a data group's dataset is stored in its HDF5 file, which
+// emdlib doesn't expose, and tells the FrameCache. The dataset is found by
+// the name of its EMD data group and checked against the data group's
+// dimensions; datasets which can't be matched are read through emdlib
+// alone.
+//
+// The FrameCache's reader and chunk cache handler are installed from here.
+// Contiguous, uncompressed datasets are mapped with the MappedFrameReader.
+// Deflate compressed chunks are fetched raw and decompressed in parallel on
+// the workers. Everything else is read with hyperslab selections through
+// the handle, whose chunk cache is the one FrameCache::tuneChunkCache()
+// sizes.
+class EMDPLUGIN_API DatasetStorage
+{
+public:
+    // Called once the data group is loaded. Returns false if its dataset
+    // couldn't be found in the file.
+    static bool attach(const DataGroup *dataGroup);
+
+    // Closes the file handles of the dataset. Called by FrameCache::remove().
+    static void detach(const Dataset *dataset);
+
+    // The size of the dataset's elements, or 0 if it isn't known, e.g. for
+    // complex data. Doesn't wait for reads.
+    static int elementBytes(const Dataset *dataset);
+};
+
+} // namespace emd
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_FRAMEBUFFERPOOL_H
+#define EMD_FRAMEBUFFERPOOL_H
+
+#include "EmdPluginLib.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <QImage>
+#include <QMutex>
+
+namespace emd
+{
+
+// Recycles the output buffers of a workflow's modules. Buffers are rounded
+// up to size classes, four per power of two, and a released buffer is kept
+// for the next request of its class instead of going back to the heap.
+// Frames scrubbed through at the same size thus reuse the same few buffers.
+// Buffers may outlive the pool, which must be owned by a std::shared_ptr.
+class EMDPLUGIN_API FrameBufferPool : public std::enable_shared_from_this<FrameBufferPool>
+{
+public:
+    struct Statistics
+    {
+        // Requests served, and how many of them by a recycled buffer
+        int64_t requests;
+        int64_t reuses;
+        int64_t bytesInUse;
+        int64_t peakBytes;
+        int64_t idleBytes;
+
+        Statistics()
+            : requests(0),
+            reuses(0),
+            bytesInUse(0),
+            peakBytes(0),
+            idleBytes(0)
+        {}
+
+        double reuseRate() const
+        {
+            if(requests == 0)
+                return 0.;
+
+            return (double) reuses / requests;
+        }
+    };
+
+public:
+    FrameBufferPool();
+    ~FrameBufferPool();
+
+    // Returns a buffer of at least the given size, aligned for vector
+    // loads.
+    void *acquire(int64_t bytes);
+    void release(void *buffer);
+
+    // Releases a buffer to the pool if it still exists, and to the heap
+    // otherwise.
+    static void release(const std::weak_ptr<FrameBufferPool> &pool, void *buffer);
+
+    // Returns an image whose pixels come from the pool. They are released
+    // when the image is deleted.
+    QImage *image(int width, int height, QImage::Format format);
+
+    // Idle buffers beyond this many bytes are freed as they are released.
+    int64_t idleLimit() const;
+    void setIdleLimit(int64_t bytes);
+
+    // Frees all idle buffers.
+    void trim();
+
+    Statistics statistics() const;
+
+private:
+    static int64_t sizeClass(int64_t bytes);
+
+private:
+    mutable QMutex m_mutex;
+    // Idle buffers by size class
+    std::map<int64_t, std::vector<void *>> m_idle;
+    // The size class of each buffer handed out
+    std::map<void *, int64_t> m_inUse;
+    int64_t m_idleLimit;
+    Statistics m_statistics;
+};
+
+} // namespace emd
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_FRAMECACHE_H
+#define EMD_FRAMECACHE_H
+
+#include "EmdPluginLib.h"
+
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+#include <QMutex>
+
+#include "Dataset.h"
+#include "FrameSet.h"
+
+namespace emd
+{
+
+class DataGroup;
+class Frame;
+
+// A process-wide cache of the frames read from datasets, shared by all
+// workflows. Frames are handed out by reference and must be treated as
+// read-only. When the cached frames exceed the memory budget the least
+// recently used ones are dropped; a frame which is still referenced by a
+// FrameSet stays alive until it is released.
+class EMDPLUGIN_API FrameCache
+{
+public:
+    struct Statistics
+    {
+        int64_t hits;
+        int64_t misses;
+        int64_t evictions;
+        int64_t bytes;
+        int64_t budget;
+        int frameCount;
+        // Reads from the same chunk as the read before, and reads which
+        // moved on to another chunk. Only counted for datasets with a
+        // known chunk shape.
+        int64_t chunkHits;
+        int64_t chunkMisses;
+
+        Statistics()
+            : hits(0),
+            misses(0),
+            evictions(0),
+            bytes(0),
+            budget(0),
+            frameCount(0),
+            chunkHits(0),
+            chunkMisses(0)
+        {}
+    };
+
+public:
+    // Reads the frames of several slices; frames has the size of slices.
+    // Frames left null are read with Dataset::frame(). Work it spreads over
+    // the workers runs at the given WorkflowModule::WorkPriority.
+    typedef std::function<void(const Dataset *, const std::vector<Dataset::Slice> &,
+                               std::vector<std::shared_ptr<Frame>> &, int priority)> Reader;
+
+    // Gives the dataset a raw-data chunk cache of the given size and hash
+    // slot count. Returns false if it couldn't.
+    typedef std::function<bool(const Dataset *, int64_t bytes, int slots)> ChunkCacheHandler;
+
+public:
+    static FrameCache &instance();
+
+    // The size of a frame's data in bytes.
+    static int64_t frameBytes(const Frame *frame);
+
+    // The budget is taken from the "Preferences/FrameCacheSize" setting, in
+    // MB. A budget of zero disables the cache.
+    int64_t budget() const;
+    void setBudget(int64_t bytes);
+
+    // Returns the cached frame for the slice, reading it from the dataset
+    // on a miss. Returns null if the read failed. The priority is the
+    // caller's WorkflowModule::WorkPriority, which the reader's work runs
+    // at.
+    std::shared_ptr<Frame> frame(const Dataset *dataset, const Dataset::Slice &slice,
+                                 int priority);
+
+    // Looks up the frames for several slices at once; frames is resized to
+    // match slices. The misses are read back to back under a single hold of
+    // the read lock. If the dataset's chunk shape is known, the reads are
+    // grouped by chunk so that each chunk is decompressed once per batch;
+    // otherwise they are read in the given order.
+    void frames(const Dataset *dataset, const std::vector<Dataset::Slice> &slices,
+                std::vector<std::shared_ptr<Frame>> &frames, int priority);
+
+    bool contains(const Dataset *dataset, const Dataset::Slice &slice) const;
+
+    // By default misses are read with Dataset::frame(), which decompresses
+    // chunks serially inside the HDF5 call. DatasetStorage installs a
+    // reader which fetches the raw chunks itself and decompresses them in
+    // parallel. The reader is given the misses of a batch at once, in
+    // chunk order, and is called without any lock held, so it must take
+    // readMutex() around its HDF5 calls. Whatever it doesn't handle
+    // (filters, layouts) falls back to the default path.
+    void setReader(const Reader &reader);
+
+    // Serialises HDF5 calls; the library is not built thread-safe. Only
+    // calls made while holding it are serialised: the cache's own reads,
+    // DatasetStorage, and the application's calls into emdlib which touch
+    // files (opening, loading, unloading, saving and closing models).
+    // Anything else calling into emdlib while workers read must take it
+    // too.
+    static QMutex &readMutex();
+
+    // The storage chunk extent of each of the dataset's dimensions. An
+    // empty shape means the layout is unknown or contiguous. Set by
+    // DatasetStorage::attach() when a data group is loaded.
+    std::vector<int64_t> chunkShape(const Dataset *dataset) const;
+    void setChunkShape(const Dataset *dataset, const std::vector<int64_t> &shape);
+
+    // HDF5 gives every dataset the library default chunk cache (1 MB, 521
+    // slots) when it is opened. The handler applies tuned cache sizes;
+    // DatasetStorage installs one which reopens its handle of the dataset
+    // with H5Pset_chunk_cache(). It is called without the cache's lock held.
+    void setChunkCacheHandler(const ChunkCacheHandler &handler);
+
+    // Sizes the dataset's chunk cache to hold every chunk that a frame of
+    // the selection touches, so that stepping along a chunked free dimension
+    // decompresses each chunk once. The caches of all datasets share the
+    // "Preferences/ChunkCacheLimit" setting, in MB. Does nothing if the
+    // chunk shape is unknown or no handler is set. Returns the cache size.
+    int64_t tuneChunkCache(const Dataset *dataset, const std::vector<int64_t> &dimensions,
+                           const FrameSet::Selection &selection, int elementBytes);
+    // Tunes for the data group's default slice. Reads the default frame to
+    // find the element size.
+    int64_t tuneChunkCache(DataGroup *dataGroup);
+
+    // Drops the dataset's frames. Must be called before a dataset is
+    // unloaded, since a later dataset may reuse its address.
+    void remove(const Dataset *dataset);
+    void clear();
+
+    Statistics statistics() const;
+
+private:
+    FrameCache();
+    FrameCache(const FrameCache &);
+    FrameCache &operator=(const FrameCache &);
+
+    typedef std::pair<const Dataset *, std::vector<int64_t>> Key;
+
+    struct Entry
+    {
+        std::shared_ptr<Frame> frame;
+        int64_t bytes;
+        std::list<Key>::iterator use;
+    };
+
+    static Key key(const Dataset *dataset, const Dataset::Slice &slice);
+    static std::vector<int64_t> chunkIndex(const Dataset::Slice &slice,
+                                           const std::vector<int64_t> &shape);
+
+    void insert(const Key &key, const std::shared_ptr<Frame> &frame);
+    // Expects m_mutex to be locked.
+    void evict();
+
+private:
+    mutable QMutex m_mutex;
+
+    std::map<Key, Entry> m_entries;
+    // Most recently used first
+    std::list<Key> m_uses;
+
+    int64_t m_budget;
+    int64_t m_bytes;
+    int64_t m_hits;
+    int64_t m_misses;
+    int64_t m_evictions;
+
+    Reader m_reader;
+
+    ChunkCacheHandler m_chunkCacheHandler;
+    std::map<const Dataset *, int64_t> m_chunkCacheSizes;
+    int64_t m_chunkCacheLimit;
+
+    std::map<const Dataset *, std::vector<int64_t>> m_chunkShapes;
+    int64_t m_chunkHits;
+    int64_t m_chunkMisses;
+};
+
+} // namespace emd
+
+#endif
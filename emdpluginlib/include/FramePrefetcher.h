@@ -0,0 +1,90 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_FRAMEPREFETCHER_H
+#define EMD_FRAMEPREFETCHER_H
+
+#include "EmdPluginLib.h"
+
+#include "WorkflowModule.h"
+
+#include <vector>
+
+#include <QElapsedTimer>
+
+#include "Dataset.h"
+#include "FrameSet.h"
+
+namespace emd
+{
+
+class DataGroup;
+
+// Reads ahead of the selection while the user steps along a free dimension.
+// Each selection change is compared with the last one; when a single free
+// dimension moves, the next slices in the same direction are loaded into
+// the FrameCache by a background job. The faster the steps come, the
+// further ahead it reads. A change of direction, dimension or selection
+// shape cancels the prefetch which is under way.
+//
+// The prefetcher is not part of a workflow; it is only a WorkflowModule so
+// that the WorkScheduler can run it.
+class EMDPLUGIN_API FramePrefetcher : public WorkflowModule
+{
+    Q_OBJECT
+
+public:
+    FramePrefetcher(DataGroup *dataGroup);
+    ~FramePrefetcher();
+
+    // WorkflowModule functions
+    WorkPriority workPriority() const override;
+    void doWork(WorkContext *context) override;
+
+public slots:
+    void updateSelection(const FrameSet::Selection &selection);
+
+private slots:
+    void prefetchFinished(WorkflowModule *module);
+
+private:
+    void startPrefetch();
+
+private:
+    DataGroup *m_dataGroup;
+
+    FrameSet::Selection m_selection;
+    QElapsedTimer m_stepTimer;
+
+    // The moving dimension, or -1, and its last step
+    int m_dimension;
+    int m_step;
+    int m_depth;
+
+    // The slices of the current job. Only changed while no job is running.
+    std::vector<Dataset::Slice> m_slices;
+
+    // Whether to plan again once the current job has finished
+    bool m_pending;
+};
+
+} // namespace emd
+
+#endif
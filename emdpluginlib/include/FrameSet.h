@@ -22,6 +22,8 @@
 
 #include "EmdPluginLib.h"
 
+#include <memory>
+
 #include "Dataset.h"
 #include "DataSpace.h"
 #include "Frame.h"
@@ -126,6 +128,19 @@ public:
 
         Dataset::Slice sliceFromIndex(int index) const;
         int indexFromSlice(const Dataset::Slice &slice) const;
+
+        // Splits the selection into consecutive windows of at most
+        // frameCount frames, each of them a selection of its own. Window
+        // boundaries follow the dimensions, so a window can hold fewer
+        // frames than asked for.
+        int windowCount(int frameCount) const;
+        Selection window(int index, int frameCount) const;
+
+    private:
+        // The dimension along which windows of frameCount frames are cut,
+        // and the number of its steps in each window; -1 if the selection
+        // fits into one window.
+        int windowDimension(int frameCount, int &steps) const;
     };
 
 public:
@@ -139,10 +154,17 @@ public:
     Frame *frame(int index) const;
     Frame *frame(Dataset::Slice slice) const;
 
+    // The frame's other owners, e.g. later frame sets, keep it alive after
+    // this frame set is gone.
+    std::shared_ptr<Frame> sharedFrame(int index) const;
+
     // The FrameSet takes ownership of its frames.
     void setFrame(Frame *frame, int index);
     void setFrame(Frame *frame, const Dataset::Slice &slice);
 
+    // Shares a frame with its other owners, e.g. the FrameCache.
+    void setSharedFrame(const std::shared_ptr<Frame> &frame, int index);
+
     //int horizontalDimension() const;
     //int verticalDimension() const;
 
@@ -155,15 +177,24 @@ public:
     bool containsSlice(const Dataset::Slice &slice) const;
 
     void subtract(const FrameSet &other, emd::FrameList &result) const;
+    void subtract(const FrameSet &other, std::vector<std::shared_ptr<Frame>> &result) const;
 
     int sliceIndex(const Dataset::Slice &slice) const;
 
+    // Frame sets streamed in bounded windows know their place in the
+    // whole selection. The default is window 0 of 1.
+    int windowIndex() const;
+    int windowCount() const;
+    void setWindow(int index, int count);
+
 private:
     friend class Selection;
 
 private:
     Selection m_selection;
-    std::vector<Frame *> m_frames;
+    std::vector<std::shared_ptr<Frame>> m_frames;
+    int m_windowIndex;
+    int m_windowCount;
 };
 
 } // namespace emd
\ No newline at end of file
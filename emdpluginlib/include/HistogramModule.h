@@ -46,6 +46,8 @@ public:
     QWidget *controlWidget() override;
     void doPropertyChanged(const QString &key) override;
     bool validate() const override;
+    ConcurrencyMode concurrencyMode() const override;
+    WorkPriority workPriority() const override;
     void preprocess() override;
 	Frame *processFrame(Frame *frame, int index) override;
     void postprocess() override;
@@ -53,6 +55,8 @@ public:
     void reset(const DataGroup *dataGroup);
 
 private:
+	template <typename> friend struct ProcessDataKernel;
+
 	template <typename T>
 	Frame *processData(Frame *frame);
 
@@ -48,11 +48,16 @@ public:
 	// Inherited from WorkflowModule
     QWidget *controlWidget() override;
     void doPropertyChanged(const QString &key) override;
+    ConcurrencyMode concurrencyMode() const override;
+    FrameLayout inputLayout() const override;
     void preprocess() override;
     void postprocess() override;
+    void discardResults() override;
 	Frame *processFrame(Frame *frame, int index) override;
 
 protected:
+	template <typename> friend struct ProcessDataKernel;
+
 	template <typename T>
 	Frame *processData(Frame *frame);
 
@@ -0,0 +1,83 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_MAPPEDFRAMEREADER_H
+#define EMD_MAPPEDFRAMEREADER_H
+
+#include "EmdPluginLib.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <QMutex>
+#include <QString>
+
+#include "Dataset.h"
+#include "Frame.h"
+
+namespace emd
+{
+
+// Serves the frames of contiguous, uncompressed datasets straight from a
+// memory mapping of the file. The frames point into the mapping through
+// their hStep/vStep strides, so reading one allocates nothing beyond the
+// Frame itself and the data comes from the page cache. The FrameCache asks
+// the reader first and doesn't cache what it returns.
+class EMDPLUGIN_API MappedFrameReader
+{
+public:
+    static MappedFrameReader &instance();
+
+    // Maps a dataset whose raw data starts offset bytes into the file and is
+    // stored in native byte order, in C order over the given dimensions (the
+    // order of Dataset::Slice). For complex data, complexDimension is the
+    // dimension of size two holding the real and imaginary parts. Returns
+    // false if the file couldn't be mapped; the dataset is then read as
+    // usual. DatasetStorage::attach() adds the datasets which qualify.
+    bool addDataset(const Dataset *dataset, const QString &filePath, int64_t offset,
+                    const std::vector<int64_t> &dimensions, DataType type,
+                    int complexDimension = -1);
+
+    // The mapping is released once the last of its frames is.
+    void removeDataset(const Dataset *dataset);
+
+    bool contains(const Dataset *dataset) const;
+
+    // Returns null if the dataset isn't mapped or the slice can't be
+    // described by a frame's strides.
+    std::shared_ptr<Frame> frame(const Dataset *dataset, const Dataset::Slice &slice) const;
+
+private:
+    MappedFrameReader();
+    MappedFrameReader(const MappedFrameReader &);
+    MappedFrameReader &operator=(const MappedFrameReader &);
+
+    struct Mapping;
+
+private:
+    mutable QMutex m_mutex;
+    std::map<const Dataset *, std::shared_ptr<Mapping>> m_mappings;
+};
+
+} // namespace emd
+
+#endif
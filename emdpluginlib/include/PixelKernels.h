@@ -0,0 +1,226 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_PIXELKERNELS_H
+#define EMD_PIXELKERNELS_H
+
+#include "EmdPluginLib.h"
+
+#include <math.h>
+#include <stdint.h>
+
+namespace emd
+{
+
+// Typed loops over runs of unit-stride samples, shared by the modules. Each
+// kernel is a class template whose generic definition is the fallback for
+// every sample type; the hot types (uint16 detectors, float and complex
+// float results) get explicit specialisations, which run the emdkernels
+// SIMD loops for the widest instruction set the CPU has. A module picks
+// them up just by calling Kernel<T>::..., so a type can be tuned without
+// touching modules.
+
+// Widens samples to float
+template <typename T>
+struct ConvertKernel
+{
+    static void run(const T *input, float *output, int count)
+    {
+        for(int iii = 0; iii < count; ++iii)
+            output[iii] = (float) input[iii];
+    }
+};
+
+template <>
+struct EMDPLUGIN_API ConvertKernel<uint16_t>
+{
+    static void run(const uint16_t *input, float *output, int count);
+};
+
+template <>
+struct EMDPLUGIN_API ConvertKernel<float>
+{
+    static void run(const float *input, float *output, int count);
+};
+
+// Amplitude, intensity and phase of split complex samples
+template <typename T>
+struct ComplexKernel
+{
+    static void amplitude(const T *real, const T *imaginary, float *output, int count)
+    {
+        for(int iii = 0; iii < count; ++iii)
+        {
+            output[iii] = sqrtf( (float) real[iii] * real[iii]
+                    + (float) imaginary[iii] * (float) imaginary[iii] );
+        }
+    }
+
+    static void intensity(const T *real, const T *imaginary, float *output, int count)
+    {
+        for(int iii = 0; iii < count; ++iii)
+        {
+            output[iii] = (float) real[iii] * real[iii]
+                + (float) imaginary[iii] * (float) imaginary[iii];
+        }
+    }
+
+    static void phase(const T *real, const T *imaginary, float *output, int count)
+    {
+        for(int iii = 0; iii < count; ++iii)
+            output[iii] = atan2f((float) imaginary[iii], (float) real[iii]);
+    }
+};
+
+template <>
+struct EMDPLUGIN_API ComplexKernel<float>
+{
+    static void amplitude(const float *real, const float *imaginary, float *output, int count);
+    static void intensity(const float *real, const float *imaginary, float *output, int count);
+    static void phase(const float *real, const float *imaginary, float *output, int count);
+};
+
+// Widens [min, max] to cover the samples. Like Frame::getDataRange(), NaNs
+// are skipped.
+template <typename T>
+struct RangeKernel
+{
+    static void run(const T *input, int count, T &min, T &max)
+    {
+        for(int iii = 0; iii < count; ++iii)
+        {
+            if(input[iii] < min)
+                min = input[iii];
+            else if(input[iii] > max)
+                max = input[iii];
+        }
+    }
+};
+
+template <>
+struct EMDPLUGIN_API RangeKernel<uint16_t>
+{
+    static void run(const uint16_t *input, int count, uint16_t &min, uint16_t &max);
+};
+
+template <>
+struct EMDPLUGIN_API RangeKernel<float>
+{
+    static void run(const float *input, int count, float &min, float &max);
+};
+
+// output = clamp(outputOffset + factor * (input - inputOffset), lower, upper)
+template <typename T>
+struct ScaleKernel
+{
+    static void run(const T *input, float *output, int count, T inputOffset,
+                    float factor, float outputOffset, float lower, float upper)
+    {
+        for(int iii = 0; iii < count; ++iii)
+        {
+            float value = outputOffset + factor * (input[iii] - inputOffset);
+
+            value = value > lower ? value : lower;
+            output[iii] = value < upper ? value : upper;
+        }
+    }
+};
+
+template <>
+struct EMDPLUGIN_API ScaleKernel<uint16_t>
+{
+    static void run(const uint16_t *input, float *output, int count, uint16_t inputOffset,
+                    float factor, float outputOffset, float lower, float upper);
+};
+
+template <>
+struct EMDPLUGIN_API ScaleKernel<float>
+{
+    static void run(const float *input, float *output, int count, float inputOffset,
+                    float factor, float outputOffset, float lower, float upper);
+};
+
+// output = table[clamp((int) (factor * (input - offset)), 0, tableMax)]
+template <typename T>
+struct ColourMapKernel
+{
+    static void run(const T *input, uint32_t *output, int count, T offset,
+                    float factor, const uint32_t *table, int tableMax)
+    {
+        int index;
+
+        for(int iii = 0; iii < count; ++iii)
+        {
+            index = (int) (factor * (input[iii] - offset));
+
+            if(index > tableMax)
+                index = tableMax;
+            else if(index < 0)
+                index = 0;
+
+            output[iii] = table[index];
+        }
+    }
+};
+
+template <>
+struct EMDPLUGIN_API ColourMapKernel<uint16_t>
+{
+    static void run(const uint16_t *input, uint32_t *output, int count, uint16_t offset,
+                    float factor, const uint32_t *table, int tableMax);
+};
+
+template <>
+struct EMDPLUGIN_API ColourMapKernel<float>
+{
+    static void run(const float *input, uint32_t *output, int count, float offset,
+                    float factor, const uint32_t *table, int tableMax);
+};
+
+// result = keep * result + weight * input, for running sums and means. The
+// generic loop works in double; the specialisations in float.
+template <typename T>
+struct AccumulateKernel
+{
+    static void run(const T *input, float *result, int count, double keep, double weight)
+    {
+        for(int iii = 0; iii < count; ++iii)
+            result[iii] = (float) (keep * result[iii] + weight * input[iii]);
+    }
+};
+
+template <>
+struct EMDPLUGIN_API AccumulateKernel<uint16_t>
+{
+    static void run(const uint16_t *input, float *result, int count, double keep, double weight);
+};
+
+template <>
+struct EMDPLUGIN_API AccumulateKernel<float>
+{
+    static void run(const float *input, float *result, int count, double keep, double weight);
+};
+
+// Name of the instruction set the specialisations run on
+EMDPLUGIN_API const char *pixelKernelInstructionSet();
+
+} // namespace emd
+
+#endif
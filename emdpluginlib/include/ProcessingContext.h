@@ -55,6 +55,11 @@ public:
     Frame *frameAtIndex(int index) const;
     void setFrameAtIndex(Frame *frame, int index);
 
+    // Frames may be shared between contexts; each is freed once the last
+    // context holding it is reset.
+    std::shared_ptr<Frame> sharedFrameAtIndex(int index) const;
+    void setSharedFrameAtIndex(const std::shared_ptr<Frame> &frame, int index);
+
 private:
     std::shared_ptr<ProcessingContextImpl> m_impl;
 };
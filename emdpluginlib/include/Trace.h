@@ -0,0 +1,90 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_TRACE_H
+#define EMD_TRACE_H
+
+#include "EmdPluginLib.h"
+
+#include <stdint.h>
+
+#include <QString>
+
+// Scoped timeline zones. When the build is configured with EMD_TRACE the
+// zones are recorded and can be saved as a Chrome trace (chrome://tracing or
+// ui.perfetto.dev) from the Debug menu; otherwise EMD_TRACE_ZONE expands to
+// nothing. The name must be a string with static storage duration, since
+// only the pointer is recorded.
+#ifdef EMD_TRACE
+#define EMD_TRACE_CONCAT_IMPL(a, b) a##b
+#define EMD_TRACE_CONCAT(a, b) EMD_TRACE_CONCAT_IMPL(a, b)
+#define EMD_TRACE_ZONE(name) \
+    emd::TraceZone EMD_TRACE_CONCAT(traceZone, __LINE__)(name)
+#else
+#define EMD_TRACE_ZONE(name)
+#endif
+
+namespace emd
+{
+
+// Each thread records into its own fixed-size ring buffer, so recording a
+// zone takes no lock. Once a buffer is full the oldest events are
+// overwritten.
+class EMDPLUGIN_API Trace
+{
+public:
+    static bool enabled();
+
+    static int64_t now();
+    static void record(const char *name, int64_t begin, int64_t end);
+
+    // Writes the events currently held by all threads' buffers in the Chrome
+    // trace event format. Returns false if the file could not be written.
+    static bool save(const QString &path);
+
+private:
+    Trace();
+};
+
+class TraceZone
+{
+public:
+    explicit TraceZone(const char *name)
+        : m_name(name),
+        m_begin(Trace::now())
+    {
+    }
+
+    ~TraceZone()
+    {
+        Trace::record(m_name, m_begin, Trace::now());
+    }
+
+private:
+    TraceZone(const TraceZone &);
+    TraceZone &operator=(const TraceZone &);
+
+    const char *m_name;
+    int64_t m_begin;
+};
+
+} // namespace emd
+
+#endif
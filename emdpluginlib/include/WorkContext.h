@@ -23,19 +23,31 @@
 
 #include "EmdPluginLib.h"
 
-#include <qobject.h>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <QMutex>
+#include <QWaitCondition>
 
 namespace emd
 {
 
 class WorkflowModule;
+class WorkJob;
 
+// A WorkContext is a range of frames belonging to a WorkJob.
 class EMDPLUGIN_API WorkContext
 {
 public:
-    WorkContext(WorkflowModule *module);
+    WorkContext();
+    WorkContext(const std::shared_ptr<WorkJob> &job, int start, int count);
+
+    bool isValid() const;
 
     WorkflowModule *module() const;
+    const std::shared_ptr<WorkJob> &job() const;
 
     int start() const;
     void setStart(int start);
@@ -44,12 +56,99 @@ public:
     void setCount(int count);
 
 private:
-    WorkflowModule *m_module;
+    std::shared_ptr<WorkJob> m_job;
 
     int m_start;
     int m_count;
 };
 
+// A WorkJob holds the state shared by all contexts of a single module run.
+//
+// Serial jobs hand out their frames in order, one run of frames at a time.
+// A streaming job gets its frames from a producer job: each frame becomes
+// available once the producer has finished it. Producers are throttled
+// when they get too far ahead of their slowest consumer.
+class EMDPLUGIN_API WorkJob : public std::enable_shared_from_this<WorkJob>
+{
+public:
+    WorkJob(WorkflowModule *module, int frameCount, bool serial, bool streaming);
+
+    WorkflowModule *module() const;
+
+    int frameCount() const;
+
+    // Serial jobs never have more than one context queued or running.
+    bool serial() const;
+
+    // The module's WorkflowModule::WorkPriority when the job was created.
+    int priority() const;
+
+    // The number of frames a worker should take from its queue at once.
+    // The chunk size adapts to the measured per-frame cost so that each
+    // chunk takes roughly the same amount of time.
+    int chunkSize() const;
+
+    // Wall time spent in doWork() so far, summed over the worker threads.
+    int64_t workTime() const;
+
+    // Appends the contexts to queue when a non-streaming job starts.
+    void start(int threadCount, std::vector<WorkContext> &runnable);
+
+    // Streams this job's frames into consumer, which may run at most
+    // window frames behind. Frames which are already finished are released
+    // to the consumer straight away.
+    void addConsumer(const std::shared_ptr<WorkJob> &consumer, int window,
+                     std::vector<WorkContext> &runnable);
+
+    // True if frames from start on are too far ahead of a consumer.
+    bool throttled(int start) const;
+
+    bool frameFinished(int index) const;
+
+    // Marks frames as processed and appends any contexts which became
+    // runnable as a result. Returns true for the call which completes the
+    // job.
+    bool finishFrames(int start, int count, int64_t nsecs,
+                      std::vector<WorkContext> &runnable);
+
+    // Called by the worker which completed the job once it is done with the
+    // module. wait() blocks until then.
+    void setDone();
+    void wait();
+
+private:
+    void releaseFrames(int start, int count, std::vector<WorkContext> &runnable);
+    void nextSerialRun(std::vector<WorkContext> &runnable);
+
+private:
+    WorkflowModule *m_module;
+    int m_frameCount;
+    bool m_serial;
+    bool m_streaming;
+    int m_priority;
+    std::atomic<int> m_remainingFrames;
+    std::atomic<int64_t> m_frameCost;
+    std::atomic<int64_t> m_workTime;
+
+    mutable QMutex m_mutex;
+
+    // Serial jobs: frames which may be handed out, the next frame to hand
+    // out, and whether a run is currently queued or in progress.
+    std::vector<char> m_available;
+    int m_nextFrame;
+    bool m_running;
+
+    // All frames below the frontier are finished.
+    std::vector<char> m_finished;
+    std::atomic<int> m_frontier;
+
+    std::vector<std::shared_ptr<WorkJob>> m_consumers;
+    int m_window;
+
+    bool m_done;
+    QWaitCondition m_doneCondition;
+};
+
 }
 
 #endif
\ No newline at end of file
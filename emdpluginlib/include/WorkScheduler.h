@@ -0,0 +1,119 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_WORKSCHEDULER_H
+#define EMD_WORKSCHEDULER_H
+
+#include "EmdPluginLib.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QWaitCondition>
+
+namespace emd
+{
+
+class TileTask;
+class WorkContext;
+class WorkerThread;
+class WorkflowModule;
+class WorkJob;
+
+// The WorkScheduler owns the worker thread pool. A module run is split into
+// frame ranges which are distributed over the workers' queues; idle workers
+// steal from busy ones. The module's workFinished() signal is emitted once,
+// from the worker which completes the last frame, and firstFrameProcessed()
+// is emitted when frame 0 is done so that consumers can be streamed.
+class EMDPLUGIN_API WorkScheduler
+{
+public:
+    static WorkScheduler &instance();
+
+    static int idealThreadCount();
+    static int environmentThreadCount();
+
+    // The number of threads in the worker pool. The count is taken from the
+    // EMD_WORKER_THREADS environment variable if it is set, otherwise from the
+    // "Preferences/WorkerThreadCount" setting. A count of zero selects one
+    // thread per hardware core.
+    int threadCount();
+    void setThreadCount(int count);
+
+    // Queues frames [0, frameCount) of the module's input context. If a
+    // producer job is given, each frame is queued once the producer has
+    // finished it.
+    std::shared_ptr<WorkJob> schedule(WorkflowModule *module, int frameCount,
+        const std::shared_ptr<WorkJob> &producer = std::shared_ptr<WorkJob>());
+
+    // Calls function(tile) for every tile in [0, tileCount) and returns when
+    // all have finished. The calling thread works on the tiles itself, and
+    // idle workers join in before taking further frames of the same or a
+    // less urgent WorkflowModule::WorkPriority.
+    void runTiles(int priority, int tileCount, const std::function<void(int)> &function);
+
+    // Called by the workers. takeWork() blocks until work is available and
+    // returns false when the thread should exit.
+    bool takeWork(WorkerThread *thread, WorkContext &context);
+    void finishWork(WorkerThread *thread, const WorkContext &context, int64_t nsecs);
+
+private:
+    WorkScheduler();
+    ~WorkScheduler();
+
+    void initialize();
+    // Searches the work of priorities below priorityLimit, most urgent first.
+    bool findWork(WorkerThread *thread, WorkContext &context, bool &throttled,
+                  int priorityLimit);
+    static void runTileTask(TileTask &task);
+    void queueWork(const std::vector<WorkContext> &work);
+    void wakeOne();
+    void wakeAll();
+
+private:
+    bool m_initialized;
+
+    // Guards the thread list. Only setThreadCount() modifies it.
+    QReadWriteLock m_threadLock;
+    std::vector<WorkerThread*> m_threads;
+    // Round robin over m_threads; queueWork() only holds the read lock
+    std::atomic<int> m_nextThread;
+
+    // Bumped whenever work is queued, so that idle workers don't miss it.
+    QMutex m_mutex;
+    QWaitCondition m_condition;
+    uint64_t m_version;
+
+    // Tile tasks with unclaimed tiles, guarded by m_mutex
+    std::vector<std::shared_ptr<TileTask>> m_tileTasks;
+
+    // Set by a worker which found only throttled work, so that the next
+    // consumer to make progress wakes it.
+    std::atomic<bool> m_throttled;
+};
+
+} // namespace emd
+
+#endif
@@ -23,49 +23,66 @@
 
 #include "EmdPluginLib.h"
 
-#include <vector>
+#include <atomic>
+#include <deque>
 
 #include <QThread>
 #include <QMutex>
-#include <QWaitCondition>
+
+#include "WorkContext.h"
+#include "WorkflowModule.h"
 
 namespace emd
 {
 
-class WorkContext;
+class WorkScheduler;
 
+// A worker owns a queue of frame ranges per priority class. It processes
+// ranges from the front of its own queues and, when those are empty, the
+// WorkScheduler lets it steal ranges from the back of the other workers'
+// queues.
 class EMDPLUGIN_API WorkerThread : public QThread
 {
 	Q_OBJECT
 
 public: 
-	WorkerThread(QObject *parent = 0);
+    WorkerThread(WorkScheduler *scheduler, int index, QObject *parent = 0);
 	~WorkerThread();
 
-	void work(WorkContext *context);
+    int index() const;
 
-    static bool available();
-    static WorkerThread *takeThread();
-    static void returnThread(WorkerThread *thread);
+    // Work is queued by the priority of its job.
+    void pushWork(const WorkContext &context);
 
-protected:
-	void run();
+    // Queues work to be done next, e.g. frames just released to a consumer
+    // while they are still in this thread's cache.
+    void pushWorkFront(const WorkContext &context);
 
-private:
-    static void initialize();
+    // Takes a chunk from the first runnable range of the given priority,
+    // splitting the range if it is larger than the job's current chunk
+    // size. Ranges of throttled producers are skipped, and throttled is set.
+    bool popWork(int priority, WorkContext &context, bool &throttled);
+
+    // Takes the back half of the last runnable range of the given priority,
+    // or the whole range if it belongs to a serial job or cannot be split.
+    bool stealWork(int priority, WorkContext &context, bool &throttled);
 
-signals:
-	void finishedProcessing(WorkerThread *);
+    // Empties the queues, e.g. when the thread is retired.
+    void takeAllWork(std::deque<WorkContext> &work);
+
+    bool shuttingDown() const;
+    void requestShutdown();
+
+protected:
+    void run();
 
 private:
-    WorkContext *m_context;
+    WorkScheduler *m_scheduler;
+    int m_index;
 
-	bool m_shuttingDown;
+    std::atomic<bool> m_shuttingDown;
 	QMutex m_mutex;
-	QWaitCondition m_condition;
-
-    static bool s_initialized;
-    static std::vector<WorkerThread*> s_freeThreads;
+    std::deque<WorkContext> m_queues[WorkflowModule::PriorityCount];
 };
 
 } // namespace emd
@@ -26,16 +26,20 @@
 #include <memory>
 #include <vector>
 
+#include <QElapsedTimer>
 #include <QList>
 #include <QObject>
+#include <QSet>
 
 #include "WorkflowModule.h"
 
 namespace emd
 {
 
+class FrameBufferPool;
 class ModuleSource;
 class WorkflowSource;
+class WorkJob;
 
 class EMDPLUGIN_API Workflow : public QObject
 {
@@ -69,6 +73,9 @@ public:
 
     const QList<WorkflowModule *> &modules() const;
 
+    // The modules draw their output buffers from this pool.
+    const std::shared_ptr<FrameBufferPool> &bufferPool() const;
+
     bool paused() const;
     void setPaused(bool paused);
 
@@ -85,12 +92,23 @@ public:
 
 private:
 	void processNextModule();
+    void launchReadyModules();
+    // A module can't start while one of its inputs is queued or running, or
+    // while a module reading its output context is still running.
+    bool inputPending(WorkflowModule *module) const;
+    bool outputRunning(WorkflowModule *module) const;
+    // Cancels the runs working on input which module is about to replace.
+    void supersede(WorkflowModule *module);
+    void forgetStreamedOutputs(WorkflowModule *module);
+    void streamOutputs(WorkflowModule *module, const std::shared_ptr<WorkJob> &job,
+                       bool configure);
     bool findInputModules(QList<WorkflowModule*> &inputModules);
     void finish();
 
 public slots:
 	void moduleOutdated(WorkflowModule *module);
 	void moduleFinishedProcessing(WorkflowModule *module);
+    void moduleFirstFrameProcessed(WorkflowModule *module);
 
 signals:
 	// Control
@@ -102,8 +120,20 @@ private:
     QString m_group;
 	QList<WorkflowModule *> m_modules;
     QList<WorkflowModule *> m_modulesToProcess;
+    // Modules whose work has been scheduled and hasn't finished yet
+    QList<WorkflowModule *> m_runningModules;
+    // Modules started (or passed through) while their input was streaming
+    QSet<WorkflowModule *> m_streamedModules;
 	bool m_active;
     bool m_paused;
+    bool m_launching;
+    bool m_relaunch;
+    // Modules waiting for their outputs to drain before their next run
+    QList<WorkflowModule *> m_continuedModules;
+    // Modules which completed a run since the workflow became active
+    QList<WorkflowModule *> m_finishedModules;
+    QElapsedTimer m_runTimer;
+    std::shared_ptr<FrameBufferPool> m_bufferPool;
 };
 
 } // namespace emd
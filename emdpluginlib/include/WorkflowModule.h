@@ -23,16 +23,23 @@
 
 #include "EmdPluginLib.h"
 
+#include <atomic>
+#include <functional>
+#include <map>
 #include <memory>
 #include <stdint.h>
 #include <vector>
 
 #include <qlist.h>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
 #include <QObject>
 #include <QString>
 
 #include "DataGroup.h"
 #include "Dataset.h"
+#include "Frame.h"
 #include "ProcessingContext.h"
 
 #define EMD_MODULE_DECLARATION \
@@ -60,10 +67,46 @@ namespace emd
 {
 
 class Frame;
+class FrameBufferPool;
 class ModuleSource;
 class WorkContext;
-class WorkerThread;
 class WorkflowModule;
+class WorkJob;
+
+// The cost of a module's latest completed run. Times are in nanoseconds.
+struct ModuleStatistics
+{
+    int64_t preprocessTime;
+    // From process() until the last frame was finished
+    int64_t processTime;
+    int64_t postprocessTime;
+    // Time spent processing frames, summed over the worker threads
+    int64_t workTime;
+    int frameCount;
+    int64_t bytesIn;
+    int64_t bytesOut;
+    int threadCount;
+
+    ModuleStatistics()
+        : preprocessTime(0),
+        processTime(0),
+        postprocessTime(0),
+        workTime(0),
+        frameCount(0),
+        bytesIn(0),
+        bytesOut(0),
+        threadCount(0)
+    {}
+
+    // The fraction of the worker pool kept busy during process()
+    double utilisation() const
+    {
+        if(processTime <= 0 || threadCount <= 0)
+            return 0.;
+
+        return (double) workTime / ((double) processTime * threadCount);
+    }
+};
 
 class ModuleListener 
 {
@@ -102,6 +145,41 @@ public:
 
     typedef int RequiredFeatures;
 
+    // Declares whether processFrame() may run on several worker threads at
+    // once. Modules which keep per-run state in members (e.g. accumulators
+    // or emitted images) must stay serial.
+    enum ConcurrencyMode {
+        ConcurrencySerial,
+        ConcurrencyParallel
+    };
+
+    // The scheduler always runs the work of the most urgent class first,
+    // switching between classes at frame and tile boundaries.
+    enum WorkPriority {
+        PriorityInteractive,    // what the user is looking at
+        PriorityAuxiliary,      // interactive extras, e.g. histograms
+        PriorityBackground,     // exports and prefetching
+        PriorityCount
+    };
+
+    // Declares whether the module may start on its input frames while the
+    // previous module is still producing them. Modules which look at the
+    // whole input set before processing (e.g. to diff it against the last
+    // run) need a barrier.
+    enum InputMode {
+        InputStreaming,
+        InputBarrier
+    };
+
+    // The memory layout processFrame() wants its input frames in. Frames
+    // in another layout are repacked before they are processed, so that
+    // kernels can run their inner loops at unit stride.
+    enum FrameLayout {
+        LayoutAny,
+        LayoutRowMajor,         // hStep 1, vStep hSize
+        LayoutColumnMajor       // vStep 1, hStep vSize
+    };
+
 protected:
 	WorkflowModule();
 
@@ -154,6 +232,54 @@ public:
 
     virtual RequiredFeatures requiredFeatures() const;
 
+    // The default is ConcurrencySerial.
+    virtual ConcurrencyMode concurrencyMode() const;
+
+    // The default is InputStreaming.
+    virtual InputMode inputMode() const;
+
+    // The default is PriorityInteractive.
+    virtual WorkPriority workPriority() const;
+
+    // The default is LayoutAny.
+    virtual FrameLayout inputLayout() const;
+
+    // Whether a run may be abandoned when its input is superseded, e.g.
+    // while a slider is being dragged. Modules which must see every frame
+    // of every run (accumulators, file output) return false.
+    // The default is true.
+    virtual bool cancellable() const;
+
+    // Whether the request isn't complete after postprocess(), e.g. while a
+    // selection is streamed in windows. The workflow runs the module again
+    // once everything downstream of it has finished with this run.
+    // The default is false.
+    virtual bool hasNextRun() const;
+
+    // Marks the current run as superseded. Workers stop taking its frames
+    // and tiles, and the workflow drops its results.
+    void cancel();
+    bool cancelled() const;
+
+    // Cancels the current run and blocks until the workers are done with
+    // the module. Modules must not be deleted while a run is on the workers.
+    void cancelAndWait();
+
+    // Called instead of postprocess() when a run was cancelled.
+    virtual void discardResults();
+
+    const ModuleStatistics &statistics() const;
+
+    // Set by the workflow the module is added to.
+    const std::shared_ptr<FrameBufferPool> &bufferPool() const;
+    void setBufferPool(const std::shared_ptr<FrameBufferPool> &pool);
+
+    // Called by the Workflow as a run goes through its phases. The
+    // statistics of a run are published once its postprocess() is timed.
+    void beginStatistics(int64_t preprocessTime);
+    void endProcessStatistics();
+    void endStatistics(int64_t postprocessTime);
+
     virtual void setInputContext(ProcessingContext context, WorkflowModule *previous);
 
 	bool enabled() const;
@@ -171,13 +297,66 @@ public:
 	virtual void process();
 	virtual void postprocess();
     
+    // Returns a new output frame, or the input frame itself to pass it on
+    // unchanged. A frame passed on is shared with the input context rather
+    // than copied. The default passes every frame on.
 	virtual Frame *processFrame(Frame *frame, int index);
 
+    // Repacks the frame into inputLayout() and runs processFrame() on it;
+    // workers and callers outside a run alike go through it. The input (or
+    // its repacked copy) is returned for frames passed on, otherwise the
+    // result owns the output frame and releases its pooled buffers with it.
+    // Results of processFrame() must not be deleted directly, and calling
+    // it directly skips the repacking.
+    std::shared_ptr<Frame> processSharedFrame(const std::shared_ptr<Frame> &frame, int index);
+
     virtual void configureOutputModule(WorkflowModule *next);
 
-    virtual WorkContext *workContext();
+    // The job of the current or last run, if the module was scheduled.
+    const std::shared_ptr<WorkJob> &job() const;
+
+    // Makes the next process() stream its frames from the given job.
+    void setInputJob(const std::shared_ptr<WorkJob> &job);
+
+    // Processes the frames in the context's range. Called on worker threads.
 	virtual void doWork(WorkContext *context);
 
+protected:
+    // Splits the lines [0, lineCount) of a frame into tiles and calls
+    // function(begin, end) for each. When a run has fewer frames than worker
+    // threads the tiles are shared with idle workers, otherwise the whole
+    // range is processed in a single call. Tiles must write disjoint parts
+    // of the output.
+    void processTiles(int lineCount, int lineLength,
+                      const std::function<void(int, int)> &function) const;
+
+    // Frame::getDataRange(), with the per-tile ranges merged on tiled runs.
+    template <typename T>
+    void getDataRange(Frame *frame, T &min, T &max) const;
+
+    // Buffers for processFrame(), taken from the workflow's buffer pool, or
+    // from the heap for modules outside a workflow.
+    void *allocateBuffer(int64_t bytes);
+    void releaseBuffer(void *buffer);
+
+    // Wraps buffers from allocateBuffer() in an output frame, which doesn't
+    // own them. They are released once the last reference to the frame
+    // returned by processSharedFrame() is.
+    Frame *createFrame(const Frame::Data<void> &data, DataType type);
+
+    // An image whose pixels come from the buffer pool
+    QImage *createImage(int width, int height, QImage::Format format);
+
+private:
+    // Hands the buffers of frames from createFrame() over to the frames'
+    // shared pointers.
+    std::shared_ptr<Frame> shareFrame(Frame *frame);
+
+    // Returns the frame itself if it is in the given layout, and a
+    // repacked copy otherwise.
+    std::shared_ptr<Frame> normaliseLayout(const std::shared_ptr<Frame> &frame,
+                                           FrameLayout layout);
+
 protected:
     struct ListenerTarget 
     {
@@ -194,12 +373,11 @@ public slots:
     // Selection Feature
     virtual void setSelectionDimensions(int) {}
 
-private slots:
-	virtual void scheduleWork(WorkerThread *thread);
-
 signals:
 	void moduleOutdated(WorkflowModule *module);
 	void workFinished(WorkflowModule *module);
+    void firstFrameProcessed(WorkflowModule *module);
+    void statisticsUpdated(WorkflowModule *module);
     void activityChanged(bool active);
 
     // Selection Feature
@@ -209,9 +387,11 @@ protected:
     QString m_name;
     QString m_group;
     QMap<QString, QVariant> m_properties;
-    uint64_t m_frameIndex;
     ProcessingContext m_inputContext;
     ProcessingContext m_outputContext;
+    std::shared_ptr<WorkJob> m_job;
+    std::shared_ptr<WorkJob> m_inputJob;
+    std::atomic<bool> m_cancelled;
 	bool m_enabled;
     bool m_active;
 	bool m_outdated;
@@ -221,7 +401,14 @@ protected:
 	QList<WorkflowModule*> m_inputModules;
     QMap<WorkflowModule*, QString> m_inputTypes;
     QMap<QString, QList<ListenerTarget>> m_listenerMap;
-	unsigned int m_activeThreadCount;
+    int m_tileCount;
+    ModuleStatistics m_statistics;
+    ModuleStatistics m_runStatistics;
+    QElapsedTimer m_processTimer;
+    std::shared_ptr<FrameBufferPool> m_bufferPool;
+    // The buffers of frames from createFrame() which aren't shared yet
+    QMutex m_pooledFramesMutex;
+    std::map<Frame *, std::pair<void *, void *>> m_pooledFrames;
 };
 
 } // namespace emd
@@ -0,0 +1,91 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_EMDKERNELS_H
+#define EMD_EMDKERNELS_H
+
+#include <stdint.h>
+
+namespace emd
+{
+
+namespace kernels
+{
+
+// Instruction sets the kernels are built for, in increasing order of width
+enum InstructionSet {
+    InstructionSetScalar,
+    InstructionSetSse2,
+    InstructionSetAvx2,
+    InstructionSetAvx512,
+    InstructionSetCount
+};
+
+// The row kernels of one instruction set. Every kernel works on 'count'
+// unit-stride samples; none of the pointers need to be aligned. Results are
+// the same on every instruction set.
+struct KernelTable
+{
+    InstructionSet instructionSet;
+
+    // Widens [min, max] to cover the samples, skipping NaNs
+    void (*rangeU16)(const uint16_t *input, int count, uint16_t &min, uint16_t &max);
+    void (*rangeF32)(const float *input, int count, float &min, float &max);
+
+    void (*convertU16)(const uint16_t *input, float *output, int count);
+
+    // output = clamp(outputOffset + factor * (input - inputOffset), lower, upper)
+    void (*scaleU16)(const uint16_t *input, float *output, int count, float inputOffset,
+                     float factor, float outputOffset, float lower, float upper);
+    void (*scaleF32)(const float *input, float *output, int count, float inputOffset,
+                     float factor, float outputOffset, float lower, float upper);
+
+    // Split complex float. The phase is within a few ulps of atan2f().
+    void (*amplitudeF32)(const float *real, const float *imaginary, float *output, int count);
+    void (*intensityF32)(const float *real, const float *imaginary, float *output, int count);
+    void (*phaseF32)(const float *real, const float *imaginary, float *output, int count);
+
+    // output = table[clamp((int) (factor * (input - offset)), 0, tableMax)]
+    void (*colourMapU16)(const uint16_t *input, uint32_t *output, int count, float offset,
+                         float factor, const uint32_t *table, int tableMax);
+    void (*colourMapF32)(const float *input, uint32_t *output, int count, float offset,
+                         float factor, const uint32_t *table, int tableMax);
+
+    // result = keep * result + weight * input
+    void (*accumulateU16)(const uint16_t *input, float *result, int count, float keep, float weight);
+    void (*accumulateF32)(const float *input, float *result, int count, float keep, float weight);
+};
+
+// The kernels of the widest instruction set the CPU and OS support. The
+// EMD_KERNEL_ISA environment variable (scalar, sse2, avx2 or avx512) caps
+// the choice, to compare them from one binary.
+const KernelTable &kernelTable();
+
+// The widest instruction set the CPU and OS support, and this build has
+// kernels for
+InstructionSet supportedInstructionSet();
+
+const char *instructionSetName(InstructionSet instructionSet);
+
+} // namespace kernels
+
+} // namespace emd
+
+#endif
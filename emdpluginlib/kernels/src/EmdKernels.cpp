@@ -0,0 +1,191 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "EmdKernels.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define EMD_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace emd
+{
+
+namespace kernels
+{
+
+// One per source file; the vector ones return false when this build
+// couldn't target their instruction set.
+void scalarKernels(KernelTable &table);
+bool sse2Kernels(KernelTable &table);
+bool avx2Kernels(KernelTable &table);
+bool avx512Kernels(KernelTable &table);
+
+static const char *s_instructionSetNames[InstructionSetCount] =
+{
+    "scalar",
+    "sse2",
+    "avx2",
+    "avx512"
+};
+
+#ifdef EMD_KERNELS_X86
+
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int registers[4])
+{
+#ifdef _MSC_VER
+    int values[4];
+    __cpuidex(values, (int) leaf, (int) subleaf);
+
+    for(int index = 0; index < 4; ++index)
+        registers[index] = (unsigned int) values[index];
+#else
+    __cpuid_count(leaf, subleaf, registers[0], registers[1], registers[2], registers[3]);
+#endif
+}
+
+// The register state the OS saves on context switches
+static uint64_t enabledRegisterState()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int low, high;
+    __asm__ __volatile__ ("xgetbv" : "=a" (low), "=d" (high) : "c" (0));
+    return ((uint64_t) high << 32) | low;
+#endif
+}
+
+static InstructionSet detectInstructionSet()
+{
+    unsigned int registers[4];
+
+    cpuid(0, 0, registers);
+    unsigned int maxLeaf = registers[0];
+
+    if(maxLeaf < 1)
+        return InstructionSetScalar;
+
+    cpuid(1, 0, registers);
+    bool sse2 = (registers[3] & (1u << 26)) != 0;
+    bool osxsave = (registers[2] & (1u << 27)) != 0;
+    bool avx = (registers[2] & (1u << 28)) != 0;
+
+    if(!sse2)
+        return InstructionSetScalar;
+
+    if(!osxsave || !avx || maxLeaf < 7)
+        return InstructionSetSse2;
+
+    // XMM and YMM state, then the opmask and both halves of ZMM as well
+    uint64_t state = enabledRegisterState();
+    bool ymmState = (state & 0x06) == 0x06;
+    bool zmmState = (state & 0xE6) == 0xE6;
+
+    cpuid(7, 0, registers);
+    bool avx2 = (registers[1] & (1u << 5)) != 0;
+    bool avx512f = (registers[1] & (1u << 16)) != 0;
+
+    if(!avx2 || !ymmState)
+        return InstructionSetSse2;
+
+    if(!avx512f || !zmmState)
+        return InstructionSetAvx2;
+
+    return InstructionSetAvx512;
+}
+
+#else
+
+static InstructionSet detectInstructionSet()
+{
+    return InstructionSetScalar;
+}
+
+#endif
+
+// Fills the table for the widest instruction set up to 'limit' that this
+// build has kernels for
+static void fillTable(KernelTable &table, InstructionSet limit)
+{
+    if(limit >= InstructionSetAvx512 && avx512Kernels(table))
+        return;
+
+    if(limit >= InstructionSetAvx2 && avx2Kernels(table))
+        return;
+
+    if(limit >= InstructionSetSse2 && sse2Kernels(table))
+        return;
+
+    scalarKernels(table);
+}
+
+static KernelTable selectKernels()
+{
+    InstructionSet limit = detectInstructionSet();
+
+    const char *requested = getenv("EMD_KERNEL_ISA");
+    if(requested)
+    {
+        for(int index = 0; index < InstructionSetCount; ++index)
+        {
+            if(strcmp(requested, s_instructionSetNames[index]) == 0 && index < limit)
+                limit = (InstructionSet) index;
+        }
+    }
+
+    KernelTable table;
+    fillTable(table, limit);
+
+    return table;
+}
+
+const KernelTable &kernelTable()
+{
+    static const KernelTable s_kernels = selectKernels();
+    return s_kernels;
+}
+
+InstructionSet supportedInstructionSet()
+{
+    KernelTable table;
+    fillTable(table, detectInstructionSet());
+
+    return table.instructionSet;
+}
+
+const char *instructionSetName(InstructionSet instructionSet)
+{
+    if(instructionSet < 0 || instructionSet >= InstructionSetCount)
+        return "unknown";
+
+    return s_instructionSetNames[instructionSet];
+}
+
+} // namespace kernels
+
+} // namespace emd
@@ -0,0 +1,105 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Built with AVX2 enabled (see CMakeLists.txt). Nothing here may run before
+// emd::kernels::kernelTable() has checked the CPU for it.
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "KernelsImpl.h"
+
+namespace emd
+{
+
+namespace kernels
+{
+
+#ifdef __AVX2__
+
+namespace
+{
+
+struct Avx2
+{
+    typedef __m256 Float;
+    typedef __m256i Int;
+    typedef __m256 Mask;
+
+    static const int kWidth = 8;
+
+    static Float load(const float *input) { return _mm256_loadu_ps(input); }
+
+    static Float load(const uint16_t *input)
+    {
+        __m128i words = _mm_loadu_si128((const __m128i *) input);
+        return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(words));
+    }
+
+    static void store(float *output, Float value) { _mm256_storeu_ps(output, value); }
+    static Float set(float value) { return _mm256_set1_ps(value); }
+
+    static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+    static Float sqrt(Float a) { return _mm256_sqrt_ps(a); }
+    static Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+    static Float sign(Float a) { return _mm256_and_ps(_mm256_set1_ps(-0.f), a); }
+    static Float flipSign(Float a, Float sign) { return _mm256_xor_ps(a, sign); }
+
+    static Mask greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static Mask less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static Mask equal(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+    static Mask both(Mask a, Mask b) { return _mm256_and_ps(a, b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+
+    static Int truncate(Float a) { return _mm256_cvttps_epi32(a); }
+
+    static void lookup(const uint32_t *table, Int index, uint32_t *output)
+    {
+        _mm256_storeu_si256((__m256i *) output,
+                            _mm256_i32gather_epi32((const int *) table, index, 4));
+    }
+};
+
+} // namespace
+
+bool avx2Kernels(KernelTable &table)
+{
+    fillKernelTable<Avx2>(table, InstructionSetAvx2);
+    return true;
+}
+
+#else
+
+bool avx2Kernels(KernelTable &)
+{
+    return false;
+}
+
+#endif
+
+} // namespace kernels
+
+} // namespace emd
@@ -0,0 +1,121 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Built with AVX-512F enabled (see CMakeLists.txt). Nothing here may run
+// before emd::kernels::kernelTable() has checked the CPU for it. Only the
+// foundation instructions are used, so the integer forms stand in for the
+// float bitwise operations, which need AVX-512DQ.
+
+#ifdef __AVX512F__
+#include <immintrin.h>
+#endif
+
+#include "KernelsImpl.h"
+
+namespace emd
+{
+
+namespace kernels
+{
+
+#ifdef __AVX512F__
+
+namespace
+{
+
+struct Avx512
+{
+    typedef __m512 Float;
+    typedef __m512i Int;
+    typedef __mmask16 Mask;
+
+    static const int kWidth = 16;
+
+    static Float load(const float *input) { return _mm512_loadu_ps(input); }
+
+    static Float load(const uint16_t *input)
+    {
+        __m256i words = _mm256_loadu_si256((const __m256i *) input);
+        return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(words));
+    }
+
+    static void store(float *output, Float value) { _mm512_storeu_ps(output, value); }
+    static Float set(float value) { return _mm512_set1_ps(value); }
+
+    static Float add(Float a, Float b) { return _mm512_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm512_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm512_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm512_div_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm512_min_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm512_max_ps(a, b); }
+    static Float sqrt(Float a) { return _mm512_sqrt_ps(a); }
+
+    static Float abs(Float a)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a),
+                                                    _mm512_set1_epi32(0x7FFFFFFF)));
+    }
+
+    static Float sign(Float a)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a),
+                                                    _mm512_set1_epi32((int) 0x80000000)));
+    }
+
+    static Float flipSign(Float a, Float sign)
+    {
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a),
+                                                    _mm512_castps_si512(sign)));
+    }
+
+    static Mask greater(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static Mask less(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static Mask equal(Float a, Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+    static Mask both(Mask a, Mask b) { return (Mask) (a & b); }
+    static Float select(Mask mask, Float a, Float b) { return _mm512_mask_blend_ps(mask, b, a); }
+
+    static Int truncate(Float a) { return _mm512_cvttps_epi32(a); }
+
+    static void lookup(const uint32_t *table, Int index, uint32_t *output)
+    {
+        _mm512_storeu_si512(output, _mm512_i32gather_epi32(index, (const void *) table, 4));
+    }
+};
+
+} // namespace
+
+bool avx512Kernels(KernelTable &table)
+{
+    fillKernelTable<Avx512>(table, InstructionSetAvx512);
+    return true;
+}
+
+#else
+
+bool avx512Kernels(KernelTable &)
+{
+    return false;
+}
+
+#endif
+
+} // namespace kernels
+
+} // namespace emd
@@ -0,0 +1,363 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// The kernels, written once against a small vector interface. Each
+// instruction set's source file defines its vector type, includes this file
+// and fills a KernelTable with fillKernelTable<Vector>(). Everything here
+// has internal linkage, so code built with AVX enabled can't be merged
+// into the copies other source files call.
+//
+// A vector type provides:
+//     Float, Int, Mask, kWidth
+//     load(const float *), load(const uint16_t *), store(float *, Float), set(float)
+//     add, sub, mul, div, min, max, sqrt, abs
+//     sign(a): a's sign bit; flipSign(a, sign): a with its sign flipped where sign's is set
+//     greater, less, equal -> Mask; both(Mask, Mask); select(Mask, a, b): mask ? a : b
+//     truncate(Float) -> Int; lookup(table, Int, uint32_t *output)
+// min() and max() return their second argument when either is a NaN, like
+// minps and maxps.
+
+#ifndef EMD_KERNELSIMPL_H
+#define EMD_KERNELSIMPL_H
+
+#include <math.h>
+#include <stdint.h>
+
+#include "EmdKernels.h"
+
+namespace emd
+{
+
+namespace kernels
+{
+
+namespace
+{
+
+// One sample at a time, for the tails of rows and for CPUs without SIMD
+struct Scalar
+{
+    typedef float Float;
+    typedef int32_t Int;
+    typedef bool Mask;
+
+    static const int kWidth = 1;
+
+    static Float load(const float *input) { return *input; }
+    static Float load(const uint16_t *input) { return (float) *input; }
+    static void store(float *output, Float value) { *output = value; }
+    static Float set(float value) { return value; }
+
+    static Float add(Float a, Float b) { return a + b; }
+    static Float sub(Float a, Float b) { return a - b; }
+    static Float mul(Float a, Float b) { return a * b; }
+    static Float div(Float a, Float b) { return a / b; }
+    static Float min(Float a, Float b) { return a < b ? a : b; }
+    static Float max(Float a, Float b) { return a > b ? a : b; }
+    static Float sqrt(Float a) { return sqrtf(a); }
+    static Float abs(Float a) { return fabsf(a); }
+    static Float sign(Float a) { return signbit(a) ? -0.f : 0.f; }
+    static Float flipSign(Float a, Float sign) { return signbit(sign) ? -a : a; }
+
+    static Mask greater(Float a, Float b) { return a > b; }
+    static Mask less(Float a, Float b) { return a < b; }
+    static Mask equal(Float a, Float b) { return a == b; }
+    static Mask both(Mask a, Mask b) { return a && b; }
+    static Float select(Mask mask, Float a, Float b) { return mask ? a : b; }
+
+    static Int truncate(Float a) { return (Int) a; }
+    static void lookup(const uint32_t *table, Int index, uint32_t *output) { *output = table[index]; }
+};
+
+const float kPi = 3.14159265358979f;
+
+// atan2() after Cephes' atanf(): |y / x| is reduced to [0, tan(pi / 8)],
+// where a short polynomial is good to about an ulp, and the quadrant is
+// restored from the signs.
+template <typename V>
+typename V::Float phaseAngle(typename V::Float y, typename V::Float x)
+{
+    typedef typename V::Float Float;
+
+    const Float zero = V::set(0.f);
+    const Float one = V::set(1.f);
+
+    Float ratio = V::abs(V::div(y, x));
+
+    typename V::Mask large = V::greater(ratio, V::set(2.414213562373095f));
+    typename V::Mask medium = V::greater(ratio, V::set(0.4142135623730950f));
+
+    Float t = V::select(large, V::div(V::set(-1.f), ratio),
+                        V::select(medium, V::div(V::sub(ratio, one), V::add(ratio, one)), ratio));
+    Float angle = V::select(large, V::set(kPi / 2),
+                            V::select(medium, V::set(kPi / 4), zero));
+
+    Float z = V::mul(t, t);
+    Float polynomial = V::sub(V::mul(V::set(8.05374449538e-2f), z), V::set(1.38776856032e-1f));
+    polynomial = V::add(V::mul(polynomial, z), V::set(1.99777106478e-1f));
+    polynomial = V::sub(V::mul(polynomial, z), V::set(3.33329491539e-1f));
+    polynomial = V::add(V::mul(V::mul(polynomial, z), t), t);
+
+    angle = V::add(angle, polynomial);
+
+    // The origin and the infinite diagonals, where 0 / 0 and inf / inf left
+    // NaNs, then the left half-plane. That is wherever x's sign bit is set,
+    // so that -0 counts as in it.
+    const Float infinity = V::set(INFINITY);
+
+    angle = V::select(V::both(V::equal(x, zero), V::equal(y, zero)), zero, angle);
+    angle = V::select(V::both(V::equal(V::abs(x), infinity), V::equal(V::abs(y), infinity)),
+                      V::set(kPi / 4), angle);
+    angle = V::select(V::less(V::flipSign(one, V::sign(x)), zero), V::sub(V::set(kPi), angle), angle);
+
+    return V::flipSign(angle, V::sign(y));
+}
+
+// Each operation handles one register of samples starting at 'index'.
+// forEach() runs it over whole registers, then one sample at a time over
+// the tail.
+template <typename V, template <typename> class Operation, typename... Args>
+void forEach(int count, Args... args)
+{
+    int vectorEnd = count - count % V::kWidth;
+
+    for(int index = 0; index < vectorEnd; index += V::kWidth)
+        Operation<V>::run(index, args...);
+
+    for(int index = vectorEnd; index < count; ++index)
+        Operation<Scalar>::run(index, args...);
+}
+
+template <typename V>
+struct Convert
+{
+    template <typename S>
+    static void run(int index, const S *input, float *output)
+    {
+        V::store(output + index, V::load(input + index));
+    }
+};
+
+template <typename V>
+struct Scale
+{
+    template <typename S>
+    static void run(int index, const S *input, float *output, float inputOffset,
+                    float factor, float outputOffset, float lower, float upper)
+    {
+        typename V::Float value = V::sub(V::load(input + index), V::set(inputOffset));
+        value = V::add(V::set(outputOffset), V::mul(V::set(factor), value));
+
+        V::store(output + index, V::min(V::max(value, V::set(lower)), V::set(upper)));
+    }
+};
+
+template <typename V>
+struct Amplitude
+{
+    static void run(int index, const float *real, const float *imaginary, float *output)
+    {
+        typename V::Float re = V::load(real + index);
+        typename V::Float im = V::load(imaginary + index);
+
+        V::store(output + index, V::sqrt(V::add(V::mul(re, re), V::mul(im, im))));
+    }
+};
+
+template <typename V>
+struct Intensity
+{
+    static void run(int index, const float *real, const float *imaginary, float *output)
+    {
+        typename V::Float re = V::load(real + index);
+        typename V::Float im = V::load(imaginary + index);
+
+        V::store(output + index, V::add(V::mul(re, re), V::mul(im, im)));
+    }
+};
+
+template <typename V>
+struct Phase
+{
+    static void run(int index, const float *real, const float *imaginary, float *output)
+    {
+        V::store(output + index, phaseAngle<V>(V::load(imaginary + index), V::load(real + index)));
+    }
+};
+
+template <typename V>
+struct ColourMap
+{
+    template <typename S>
+    static void run(int index, const S *input, uint32_t *output, float offset,
+                    float factor, const uint32_t *table, int tableMax)
+    {
+        typename V::Float value = V::mul(V::set(factor), V::sub(V::load(input + index), V::set(offset)));
+
+        // Clamping before the conversion also sends NaNs to the bottom of
+        // the table.
+        value = V::min(V::max(value, V::set(0.f)), V::set((float) tableMax));
+
+        V::lookup(table, V::truncate(value), output + index);
+    }
+};
+
+template <typename V>
+struct Accumulate
+{
+    template <typename S>
+    static void run(int index, const S *input, float *result, float keep, float weight)
+    {
+        typename V::Float value = V::mul(V::set(keep), V::load(result + index));
+        value = V::add(value, V::mul(V::set(weight), V::load(input + index)));
+
+        V::store(result + index, value);
+    }
+};
+
+// The range is kept in float, which holds every uint16 exactly
+template <typename V, typename S>
+void range(const S *input, int count, float &min, float &max)
+{
+    int index = 0;
+    int vectorEnd = count - count % V::kWidth;
+
+    if(vectorEnd > 0)
+    {
+        typename V::Float lower = V::set(min);
+        typename V::Float upper = V::set(max);
+
+        for(; index < vectorEnd; index += V::kWidth)
+        {
+            typename V::Float samples = V::load(input + index);
+
+            lower = V::min(samples, lower);
+            upper = V::max(samples, upper);
+        }
+
+        float lanes[V::kWidth];
+
+        V::store(lanes, lower);
+        for(int lane = 0; lane < V::kWidth; ++lane)
+            min = Scalar::min(lanes[lane], min);
+
+        V::store(lanes, upper);
+        for(int lane = 0; lane < V::kWidth; ++lane)
+            max = Scalar::max(lanes[lane], max);
+    }
+
+    for(; index < count; ++index)
+    {
+        float sample = Scalar::load(input + index);
+
+        min = Scalar::min(sample, min);
+        max = Scalar::max(sample, max);
+    }
+}
+
+/******************************** Table entries **********************************/
+
+template <typename V>
+void rangeU16(const uint16_t *input, int count, uint16_t &min, uint16_t &max)
+{
+    float lower = min, upper = max;
+
+    range<V>(input, count, lower, upper);
+
+    min = (uint16_t) lower;
+    max = (uint16_t) upper;
+}
+
+template <typename V>
+void rangeF32(const float *input, int count, float &min, float &max)
+{
+    range<V>(input, count, min, max);
+}
+
+template <typename V>
+void convertU16(const uint16_t *input, float *output, int count)
+{
+    forEach<V, Convert>(count, input, output);
+}
+
+template <typename V, typename S>
+void scale(const S *input, float *output, int count, float inputOffset,
+           float factor, float outputOffset, float lower, float upper)
+{
+    forEach<V, Scale>(count, input, output, inputOffset, factor, outputOffset, lower, upper);
+}
+
+template <typename V>
+void amplitudeF32(const float *real, const float *imaginary, float *output, int count)
+{
+    forEach<V, Amplitude>(count, real, imaginary, output);
+}
+
+template <typename V>
+void intensityF32(const float *real, const float *imaginary, float *output, int count)
+{
+    forEach<V, Intensity>(count, real, imaginary, output);
+}
+
+template <typename V>
+void phaseF32(const float *real, const float *imaginary, float *output, int count)
+{
+    forEach<V, Phase>(count, real, imaginary, output);
+}
+
+template <typename V, typename S>
+void colourMap(const S *input, uint32_t *output, int count, float offset,
+               float factor, const uint32_t *table, int tableMax)
+{
+    forEach<V, ColourMap>(count, input, output, offset, factor, table, tableMax);
+}
+
+template <typename V, typename S>
+void accumulate(const S *input, float *result, int count, float keep, float weight)
+{
+    forEach<V, Accumulate>(count, input, result, keep, weight);
+}
+
+template <typename V>
+void fillKernelTable(KernelTable &table, InstructionSet instructionSet)
+{
+    table.instructionSet = instructionSet;
+
+    table.rangeU16 = &rangeU16<V>;
+    table.rangeF32 = &rangeF32<V>;
+    table.convertU16 = &convertU16<V>;
+    table.scaleU16 = &scale<V, uint16_t>;
+    table.scaleF32 = &scale<V, float>;
+    table.amplitudeF32 = &amplitudeF32<V>;
+    table.intensityF32 = &intensityF32<V>;
+    table.phaseF32 = &phaseF32<V>;
+    table.colourMapU16 = &colourMap<V, uint16_t>;
+    table.colourMapF32 = &colourMap<V, float>;
+    table.accumulateU16 = &accumulate<V, uint16_t>;
+    table.accumulateF32 = &accumulate<V, float>;
+}
+
+} // namespace
+
+} // namespace kernels
+
+} // namespace emd
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EMD_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "KernelsImpl.h"
+
+namespace emd
+{
+
+namespace kernels
+{
+
+#ifdef EMD_KERNELS_SSE2
+
+namespace
+{
+
+struct Sse2
+{
+    typedef __m128 Float;
+    typedef __m128i Int;
+    typedef __m128 Mask;
+
+    static const int kWidth = 4;
+
+    static Float load(const float *input) { return _mm_loadu_ps(input); }
+
+    static Float load(const uint16_t *input)
+    {
+        __m128i words = _mm_loadl_epi64((const __m128i *) input);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, _mm_setzero_si128()));
+    }
+
+    static void store(float *output, Float value) { _mm_storeu_ps(output, value); }
+    static Float set(float value) { return _mm_set1_ps(value); }
+
+    static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+    static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+    static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+    static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+    static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+    static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+    static Float sqrt(Float a) { return _mm_sqrt_ps(a); }
+    static Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+    static Float sign(Float a) { return _mm_and_ps(_mm_set1_ps(-0.f), a); }
+    static Float flipSign(Float a, Float sign) { return _mm_xor_ps(a, sign); }
+
+    static Mask greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+    static Mask less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+    static Mask equal(Float a, Float b) { return _mm_cmpeq_ps(a, b); }
+    static Mask both(Mask a, Mask b) { return _mm_and_ps(a, b); }
+
+    static Float select(Mask mask, Float a, Float b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    static Int truncate(Float a) { return _mm_cvttps_epi32(a); }
+
+    // SSE2 has no gather
+    static void lookup(const uint32_t *table, Int index, uint32_t *output)
+    {
+        int32_t lanes[kWidth];
+        _mm_storeu_si128((__m128i *) lanes, index);
+
+        for(int lane = 0; lane < kWidth; ++lane)
+            output[lane] = table[lanes[lane]];
+    }
+};
+
+} // namespace
+
+bool sse2Kernels(KernelTable &table)
+{
+    fillKernelTable<Sse2>(table, InstructionSetSse2);
+    return true;
+}
+
+#else
+
+bool sse2Kernels(KernelTable &)
+{
+    return false;
+}
+
+#endif
+
+} // namespace kernels
+
+} // namespace emd
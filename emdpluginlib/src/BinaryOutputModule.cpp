@@ -19,8 +19,15 @@
  */
 
 #include "BinaryOutputModule.h"
-#include <qthread.h>
+
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#include "DataTypeDispatch.h"
 #include "Frame.h"
+#include "PixelKernels.h"
 
 namespace emd
 {
@@ -114,6 +121,28 @@ void BinaryOutputModule::setOutputType(DataType type)
 
 /******************************** Workflow Module **********************************/
 
+WorkflowModule::ConcurrencyMode BinaryOutputModule::concurrencyMode() const
+{
+    return ConcurrencyParallel;
+}
+
+WorkflowModule::WorkPriority BinaryOutputModule::workPriority() const
+{
+    // Exports may take minutes and must not hold up the viewer.
+    return PriorityBackground;
+}
+
+WorkflowModule::FrameLayout BinaryOutputModule::inputLayout() const
+{
+    return LayoutRowMajor;
+}
+
+bool BinaryOutputModule::cancellable() const
+{
+    // Every frame of an export has to be written.
+    return false;
+}
+
 void BinaryOutputModule::postprocess()
 {
     for(int index = 0; index < m_outputContext.frameCount(); ++index)
@@ -132,65 +161,74 @@ void BinaryOutputModule::doWork(WorkContext *context)
 
 Frame *BinaryOutputModule::processFrame(Frame *frame, int /*index*/)
 {
-	switch(frame->dataType())
-	{
-	case DataTypeInt8:
-		return processData<int8_t>(frame);
-	case DataTypeInt16:
-		return processData<int16_t>(frame);
-	case DataTypeInt32:
-		return processData<int32_t>(frame);
-	case DataTypeInt64:
-		return processData<int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<float>(frame);
-	case DataTypeFloat64:
-		return processData<double>(frame);
-	default:
-		break;
-	}
-    QThread::sleep(5);
-    return NULL;
+    return dispatchDataTypes<OutputKernel>(frame->dataType(), m_dataType, this, frame);
+}
+
+// The floats nearest to value within the range of U. (float) INT32_MAX is
+// 2^31, which doesn't fit an int32_t.
+template <typename U>
+static float floatBelow(U value)
+{
+    float result = (float) value;
+
+    if((double) result > (double) value)
+        result = std::nextafter(result, -std::numeric_limits<float>::infinity());
+
+    return result;
+}
+
+template <typename U>
+static float floatAbove(U value)
+{
+    float result = (float) value;
+
+    if((double) result < (double) value)
+        result = std::nextafter(result, std::numeric_limits<float>::infinity());
+
+    return result;
+}
+
+// Scales a row into [oMin, oMax], by way of a float line
+template <typename T, typename U>
+static void scaleRow(const T *input, U *output, float *line, int count,
+                     T iMin, double factor, U oMin, U oMax, std::false_type)
+{
+    ScaleKernel<T>::run(input, line, count, iMin, (float) factor, (float) oMin,
+                        floatAbove(oMin), floatBelow(oMax));
+
+    for(int iii = 0; iii < count; ++iii)
+        output[iii] = (U) line[iii];
 }
 
+// Float output needs no line
 template <typename T>
-Frame *BinaryOutputModule::processData(Frame *frame)
+static void scaleRow(const T *input, float *output, float * /*line*/, int count,
+                     T iMin, double factor, float oMin, float oMax, std::false_type)
 {
-    switch(m_dataType)
-	{
-	case DataTypeInt8:
-		return processData<T, int8_t>(frame);
-	case DataTypeInt16:
-		return processData<T, int16_t>(frame);
-	case DataTypeInt32:
-		return processData<T, int32_t>(frame);
-	case DataTypeInt64:
-		return processData<T, int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<T, uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<T, uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<T, uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<T, uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<T, float>(frame);
-	case DataTypeFloat64:
-		return processData<T, double>(frame);
-	default:
-		break;
-	}
-
-    return NULL;
+    ScaleKernel<T>::run(input, output, count, iMin, (float) factor, oMin, oMin, oMax);
+}
+
+// Float64 and 64 bit integer outputs need more precision than a float has,
+// so they are scaled in double. (double) INT64_MAX rounds up past the
+// limit, so the limits are assigned rather than converted.
+template <typename T, typename U>
+static void scaleRow(const T *input, U *output, float * /*line*/, int count,
+                     T iMin, double factor, U oMin, U oMax, std::true_type)
+{
+    double lower = (double) oMin;
+    double upper = (double) oMax;
+
+    for(int iii = 0; iii < count; ++iii)
+    {
+        double value = lower + factor * ((double) input[iii] - (double) iMin);
+
+        if(!(value > lower))
+            output[iii] = oMin;
+        else if(value >= upper)
+            output[iii] = oMax;
+        else
+            output[iii] = (U) value;
+    }
 }
 
 template <typename T, typename U>
@@ -198,123 +236,100 @@ Frame *BinaryOutputModule::processData(Frame *frame)
 {
 	Frame::Data<T> data = frame->data<T>();
 
-    U *realOutput = new U[data.hSize * data.vSize];
+    int64_t outputBytes = (int64_t) data.hSize * data.vSize * sizeof(U);
+
+    U *realOutput = (U *) allocateBuffer(outputBytes);
     
     U *imaginaryOutput = NULL;
     if(data.imaginary)
-        imaginaryOutput = new U[data.hSize * data.vSize];
+        imaginaryOutput = (U *) allocateBuffer(outputBytes);
 
     if(m_processingMode == ProcessingModeTruncate)
     {
-	    int kkk = 0;
-        int qqq = 0;
-	    int offset = 0;
-
-        if(imaginaryOutput)
+        // Each tile copies a range of rows
+        processTiles(data.vSize, data.hSize, [&](int begin, int end)
         {
-		    for(int jjj = 0; jjj < data.vSize; ++jjj)
-		    {
-			    for(int iii = 0; iii < data.hSize; ++iii)
-			    {
-				    realOutput[qqq] = (U) data.real[kkk];
-                    imaginaryOutput[qqq] = (U) data.imaginary[kkk];
-				    kkk += data.hStep;
-                    ++qqq;
-			    }
-			    offset += data.vStep;
-			    kkk = offset;
-		    }
-        }
-        else
-        {
-            for(int jjj = 0; jjj < data.vSize; ++jjj)
-		    {
-			    for(int iii = 0; iii < data.hSize; ++iii)
-			    {
-				    realOutput[qqq] = (U) data.real[kkk];
-				    kkk += data.hStep;
-                    ++qqq;
-			    }
-			    offset += data.vStep;
-			    kkk = offset;
-		    }
-        }
+            int offset = begin * data.vStep;
+            int kkk = offset;
+            int qqq = begin * data.hSize;
+
+            if(imaginaryOutput)
+            {
+                for(int jjj = begin; jjj < end; ++jjj)
+                {
+                    for(int iii = 0; iii < data.hSize; ++iii)
+                    {
+                        realOutput[qqq] = (U) data.real[kkk];
+                        imaginaryOutput[qqq] = (U) data.imaginary[kkk];
+                        kkk += data.hStep;
+                        ++qqq;
+                    }
+                    offset += data.vStep;
+                    kkk = offset;
+                }
+            }
+            else
+            {
+                for(int jjj = begin; jjj < end; ++jjj)
+                {
+                    for(int iii = 0; iii < data.hSize; ++iii)
+                    {
+                        realOutput[qqq] = (U) data.real[kkk];
+                        kkk += data.hStep;
+                        ++qqq;
+                    }
+                    offset += data.vStep;
+                    kkk = offset;
+                }
+            }
+        });
     }
     else if(m_processingMode == ProcessingModeScale)
     {
         T iMin, iMax;
 
-	    frame->getDataRange(iMin, iMax);
+	    getDataRange(frame, iMin, iMax);
 
-        T iRange = iMax - iMin;
+        // The ranges of integer types may not fit the types themselves
+        double iRange = (double) iMax - (double) iMin;
         if(iRange == 0)
             iRange = 1;
 
         U oMin = m_minScalingLimit.value<U>();
         U oMax = m_maxScalingLimit.value<U>();
 
-        float oRange = oMax - oMin;
+        double oRange = (double) oMax - (double) oMin;
         if(oRange == 0)
             oRange = 1;
 
-        int kkk = 0;
-        int qqq = 0;
-	    int offset = 0;
+        double factor = oRange / iRange;
 
-        if(imaginaryOutput)
-        {
-		    for(int jjj = 0; jjj < data.vSize; ++jjj)
-		    {
-			    for(int iii = 0; iii < data.hSize; ++iii)
-			    {
-				    realOutput[qqq] = (U) (oMin + (oRange * (data.real[kkk] - iMin)) / iRange);
-
-                    // This might cause integer underflow/overflow depending on the
-                    // types and values.
-                    if(realOutput[qqq] < oMin)
-                        realOutput[qqq] = oMin;
-                    else if(realOutput[qqq] > oMax)
-                        realOutput[qqq] = oMax;
-
-                    imaginaryOutput[qqq] = (U) (oMin + (oRange * (data.imaginary[kkk] - iMin)) / iRange);
-
-                    if(imaginaryOutput[qqq] < oMin)
-                        imaginaryOutput[qqq] = oMin;
-                    else if(imaginaryOutput[qqq] > oMax)
-                        imaginaryOutput[qqq] = oMax;
-
-				    kkk += data.hStep;
-                    ++qqq;
-			    }
-			    offset += data.vStep;
-			    kkk = offset;
-		    }
-        }
-        else
+        std::integral_constant<bool, sizeof(U) == 8> wide;
+
+        processTiles(data.vSize, data.hSize, [&](int begin, int end)
         {
-            for(int jjj = 0; jjj < data.vSize; ++jjj)
-		    {
-			    for(int iii = 0; iii < data.hSize; ++iii)
-			    {
-				    realOutput[qqq] = (U) (oMin + (oRange * (data.real[kkk] - iMin)) / iRange);
-
-                    if(realOutput[qqq] < oMin)
-                        realOutput[qqq] = oMin;
-                    else if(realOutput[qqq] > oMax)
-                        realOutput[qqq] = oMax;
-
-				    kkk += data.hStep;
-                    ++qqq;
-			    }
-			    offset += data.vStep;
-			    kkk = offset;
-		    }
-        }
+            // Rows are clamped to [oMin, oMax] before they are converted, so
+            // out of range values can't wrap around in integer outputs
+            std::vector<float> line(wide ? 0 : data.hSize);
+
+            for(int jjj = begin; jjj < end; ++jjj)
+            {
+                scaleRow(data.real + jjj * data.vStep, realOutput + jjj * data.hSize,
+                         line.data(), data.hSize, iMin, factor, oMin, oMax, wide);
+
+                if(imaginaryOutput)
+                {
+                    scaleRow(data.imaginary + jjj * data.vStep, imaginaryOutput + jjj * data.hSize,
+                             line.data(), data.hSize, iMin, factor, oMin, oMax, wide);
+                }
+            }
+        });
     }
 
-    Frame *outputFrame = new Frame(realOutput, imaginaryOutput, 1, data.hSize, data.hSize, data.vSize, m_dataType);
+    Frame::Data<U> outputData(data.attributes, 1, data.hSize, data.hSize, data.vSize,
+                              realOutput, imaginaryOutput);
 
-    return outputFrame;
+    return createFrame(Frame::Data<void>(outputData), m_dataType);
 }
 
 } //namespace emd
\ No newline at end of file
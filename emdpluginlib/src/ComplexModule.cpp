@@ -27,7 +27,9 @@
 #include <qgroupbox.h>
 #include <QVBoxLayout>
 
+#include "DataTypeDispatch.h"
 #include "Frame.h"
+#include "PixelKernels.h"
 
 namespace emd
 {
@@ -83,35 +85,19 @@ void ComplexModule::setInputContext(ProcessingContext context, WorkflowModule *p
     WorkflowModule::setInputContext(context, previous);
 }
 
-Frame *ComplexModule::processFrame(Frame *frame, int /*index*/)
+WorkflowModule::ConcurrencyMode ComplexModule::concurrencyMode() const
 {
-	switch(frame->dataType())
-	{
-	case DataTypeInt8:
-		return processData<int8_t>(frame);
-	case DataTypeInt16:
-		return processData<int16_t>(frame);
-	case DataTypeInt32:
-		return processData<int32_t>(frame);
-	case DataTypeInt64:
-		return processData<int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<float>(frame);
-	case DataTypeFloat64:
-		return processData<double>(frame);
-	default:
-		break;
-	}
+    return ConcurrencyParallel;
+}
 
-    return NULL;
+WorkflowModule::FrameLayout ComplexModule::inputLayout() const
+{
+    return LayoutRowMajor;
+}
+
+Frame *ComplexModule::processFrame(Frame *frame, int /*index*/)
+{
+	return dispatchDataType<ProcessDataKernel>(frame->dataType(), this, frame);
 }
 
 template <typename T>
@@ -121,121 +107,49 @@ emd::Frame *ComplexModule::processData(Frame *frame)
 	Frame::Data<float> oData(iData.attributes,
                                 1, iData.hSize,
                                 iData.hSize, iData.vSize,
-                                new float[iData.size()], NULL);
+                                (float *) allocateBuffer((int64_t) iData.size() * sizeof(float)),
+                                NULL);
 
 	if((oData.attributes & Frame::AttributeComplex))
 	{
 		oData.unsetAttribute(Frame::AttributeComplex);
 	}
 
-	int inputPos = 0, outputPos = 0;
-	int inputOffset = 0, outputOffset = 0;
-
-	switch (m_complexType)
+	// Each tile converts a range of rows. The input is row-major (see
+	// inputLayout()), so the inner loops run at unit stride.
+	processTiles(iData.vSize, iData.hSize, [&](int begin, int end)
 	{
-	case ComplexTypeReal:
-		for(int iii = 0; iii < iData.hSize; ++iii)
-		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			{
-				oData.real[outputPos] = (float) iData.real[inputPos];
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
-			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
-		}
-		break;
-	case ComplexTypeImaginary:
-		for(int iii = 0; iii < iData.hSize; ++iii)
-		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			{
-				oData.real[outputPos] = (float) iData.imaginary[inputPos];
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
-			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
-		}
-		break;
-	case ComplexTypePhase:
-		for(int iii = 0; iii < iData.hSize; ++iii)
-		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			{
-				oData.real[outputPos] 
-					= atan2f((float) iData.imaginary[inputPos], 
-						(float) iData.real[inputPos]);
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
-			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
-		}
-		break;
-	case ComplexTypeAmplitude:
-		for(int iii = 0; iii < iData.hSize; ++iii)
-		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			{
-				oData.real[outputPos] 
-					= sqrtf( (float) iData.real[inputPos] * iData.real[inputPos] 
-							+ (float) iData.imaginary[inputPos] 
-							* (float) iData.imaginary[inputPos] );
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
-			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
-		}
-		break;
-	case ComplexTypeIntensity:
-		for(int iii = 0; iii < iData.hSize; ++iii)
-		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			{
-				oData.real[outputPos] 
-					= (float) iData.real[inputPos] * iData.real[inputPos] 
-						+ (float) iData.imaginary[inputPos] 
-						* (float) iData.imaginary[inputPos];
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
-			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
-		}
-		break;
-	case ComplexTypeUnwrappedPhase:
-		for(int iii = 0; iii < iData.hSize; ++iii)
+		for(int jjj = begin; jjj < end; ++jjj)
 		{
-			for(int jjj = 0; jjj < iData.vSize; ++jjj)
+			const T *real = iData.real + jjj * iData.vStep;
+			const T *imaginary = iData.imaginary ? iData.imaginary + jjj * iData.vStep : NULL;
+			float *output = oData.real + jjj * oData.vStep;
+
+			switch (m_complexType)
 			{
-				oData.real[outputPos] = iData.real[inputPos];
-				inputPos += iData.vStep;
-				outputPos += oData.vStep;
+			case ComplexTypeReal:
+			case ComplexTypeUnwrappedPhase:
+				ConvertKernel<T>::run(real, output, iData.hSize);
+				break;
+			case ComplexTypeImaginary:
+				ConvertKernel<T>::run(imaginary, output, iData.hSize);
+				break;
+			case ComplexTypePhase:
+				ComplexKernel<T>::phase(real, imaginary, output, iData.hSize);
+				break;
+			case ComplexTypeAmplitude:
+				ComplexKernel<T>::amplitude(real, imaginary, output, iData.hSize);
+				break;
+			case ComplexTypeIntensity:
+				ComplexKernel<T>::intensity(real, imaginary, output, iData.hSize);
+				break;
+			default:
+				break;
 			}
-			inputOffset += iData.hStep;
-			outputOffset += oData.hStep;
-			inputPos = inputOffset;
-			outputPos = outputOffset;
 		}
-		break;
-	default:
-		break;
-	}
+	});
 
-    return new Frame(Frame::Data<void>(oData), emd::DataTypeFloat32);
+    return createFrame(Frame::Data<void>(oData), emd::DataTypeFloat32);
 }
 
 // Slots
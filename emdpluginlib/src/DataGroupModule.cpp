@@ -20,20 +20,58 @@
 
 #include "DataGroupModule.h"
 
+#include <algorithm>
+
 #include <qdebug.h>
+#include <QSettings>
 
 #include "DataGroup.h"
 #include "Dataset.h"
+#include "DatasetStorage.h"
+#include "FrameCache.h"
 #include "FrameSet.h"
+#include "Trace.h"
+#include "WorkContext.h"
+#include "WorkScheduler.h"
 
 namespace emd
 {
 
 EMD_MODULE_DEFINITION(DataGroupModule)
 
+static const int kDefaultStreamingLimit = 2048;  // MB
+// Complex Float64
+static const int kMaxElementBytes = 16;
+// Frames read between checks for cancellation
+static const int kReadBatchFrames = 32;
+
+// Unset until first used
+static int64_t s_streamingLimit = -1;
+
+int64_t DataGroupModule::streamingLimit()
+{
+    if(s_streamingLimit < 0)
+    {
+        QSettings settings;
+        s_streamingLimit = settings.value("Preferences/StreamingLimit", kDefaultStreamingLimit)
+            .toLongLong() * 1024 * 1024;
+    }
+
+    return s_streamingLimit;
+}
+
+void DataGroupModule::setStreamingLimit(int64_t bytes)
+{
+    s_streamingLimit = std::max<int64_t>(0, bytes);
+}
+
 DataGroupModule::DataGroupModule(const DataGroup *dataGroup)
 	: m_processSelectionIndividually(true),
-    m_selectionIterator(nullptr)
+    m_selectionIterator(nullptr),
+    m_windowIndex(0),
+    m_windowCount(1),
+    m_windowFrames(0),
+    m_dataset(nullptr)
 {
     m_properties["Source"] = "Automatic";
 
@@ -82,47 +120,87 @@ void DataGroupModule::doPropertyChanged(const QString &key)
 
 void DataGroupModule::preprocess()
 {
-    m_outputContext.reset();
-    m_outputContext.init(**m_selectionIterator);
+    EMD_TRACE_ZONE("DataGroupModule::preprocess");
 
-    const Dataset *dataset = this->dataGroup()->data();
+    FrameSet::Selection selection = **m_selectionIterator;
 
-    FrameSet *frameSet = m_outputContext.frameSet();
+    if(m_windowIndex == 0)
+        planWindows(selection);
 
-    // TODO: make the iterator code work for 2D slices.
-    // Currently, beginSlice will be equal to endSlice in the 2D case
-    // and thus we won't add the frame to the frameSet.
-    if(frameSet->count() > 1)
-    {
-        auto it = frameSet->beginSlice();
-        auto end = frameSet->endSlice();
+    if(m_windowCount > 1)
+        selection = selection.window(m_windowIndex, m_windowFrames);
 
-        while(it != end)
-        {
-            const Dataset::Slice &slice = *it;
+    // The frames are read by process(), off the GUI thread
+    m_outputContext.reset();
+    m_outputContext.init(selection);
+    m_outputContext.frameSet()->setWindow(m_windowIndex, m_windowCount);
+}
 
-            frameSet->setFrame(dataset->frame(slice), slice);
+void DataGroupModule::process()
+{
+    // Unlike the default implementation, this keeps the output context set
+    // up by preprocess().
+    m_cancelled.store(false);
+    m_tileCount = 1;
 
-            ++it;
-        }
-    }
-    else
-    {
-        auto it = frameSet->beginSlice();
-        const Dataset::Slice &slice = *it;
+    // Properties are only read on the GUI thread
+    m_dataset = dataGroup()->data();
 
-        frameSet->setFrame(dataset->frame(slice), slice);
+    int frameCount = m_outputContext.frameSet()->count();
+
+    if(frameCount == 0)
+    {
+        m_job.reset();
+        emit(workFinished(this));
+        return;
     }
+
+    // The frames are read in order by one worker at a time, and the outputs
+    // are streamed each frame as soon as it has been read.
+    m_job = WorkScheduler::instance().schedule(this, frameCount);
 }
 
-void DataGroupModule::process()
+void DataGroupModule::doWork(WorkContext *context)
 {
-    // Do nothing. The default WorkflowModule implementation resets the output context.
-    emit(workFinished(this));
+    EMD_TRACE_ZONE("DataGroupModule::doWork");
+
+    FrameSet *frameSet = m_outputContext.frameSet();
+
+    int end = context->start() + context->count();
+
+    // The range is read in batches, in selection order. Indexing the
+    // selection also covers 2D data, where beginSlice() is equal to
+    // endSlice().
+    for(int start = context->start(); start < end; start += kReadBatchFrames)
+    {
+        // A superseded selection isn't worth reading; its frames stay empty
+        if(cancelled())
+            return;
+
+        int count = std::min(kReadBatchFrames, end - start);
+
+        std::vector<Dataset::Slice> slices;
+        slices.reserve(count);
+
+        for(int index = start; index < start + count; ++index)
+            slices.push_back(frameSet->selection().sliceFromIndex(index));
+
+        std::vector<std::shared_ptr<Frame>> frames;
+        FrameCache::instance().frames(m_dataset, slices, frames, workPriority());
+
+        for(int index = 0; index < count; ++index)
+            frameSet->setSharedFrame(frames[index], start + index);
+    }
 }
 
 void DataGroupModule::postprocess()
 {
+    // The workflow starts the next window once this one has been consumed
+    if(++m_windowIndex < m_windowCount)
+        return;
+
+    m_windowIndex = 0;
+
     if(m_processSelectionIndividually)
     {
         if(++*m_selectionIterator != m_selection.endSelection())
@@ -147,6 +225,11 @@ void DataGroupModule::postprocess()
     }
 }
 
+bool DataGroupModule::hasNextRun() const
+{
+    return m_windowIndex > 0;
+}
+
 // DataGroupModule functions
 
 void DataGroupModule::setSlice(const Dataset::Slice &slice)
@@ -160,6 +243,7 @@ void DataGroupModule::setSelection(const FrameSet::Selection &selection)
 		    return;
 
     m_selection = selection;
+    m_windowIndex = 0;
 
     if(m_processSelectionIndividually)
     {
@@ -176,6 +260,43 @@ const DataGroup *DataGroupModule::dataGroup() const
     return property("DataGroup").value<const DataGroup *>();
 }
 
+void DataGroupModule::planWindows(const FrameSet::Selection &selection)
+{
+    m_windowCount = 1;
+
+    int64_t limit = streamingLimit();
+
+    if(limit == 0 || selection.count() <= 1)
+        return;
+
+    // The frames of a selection share their size, which is worked out from
+    // the dimensions rather than read on the GUI thread
+    const DataGroup *dataGroup = this->dataGroup();
+    Dataset::Slice slice = selection.sliceFromIndex(0);
+
+    int64_t frameBytes = DatasetStorage::elementBytes(dataGroup->data());
+
+    // An unknown type is taken to be the widest, which only makes the
+    // windows smaller
+    if(frameBytes <= 0)
+        frameBytes = kMaxElementBytes;
+
+    for(int index = 0; index < (int) slice.size(); ++index)
+    {
+        if(slice[index] == Dataset::HorizontalDimension || slice[index] == Dataset::VerticalDimension)
+            frameBytes *= dataGroup->dimData(index)->dimLength(0);
+    }
+
+    if(frameBytes <= 0 || frameBytes * selection.count() <= limit)
+        return;
+
+    // While a window is read, its outputs may still hold the one before
+    int64_t frames = limit / 2 / frameBytes;
+
+    m_windowFrames = (int) std::max<int64_t>(1, std::min<int64_t>(frames, selection.count()));
+    m_windowCount = selection.windowCount(m_windowFrames);
+}
+
 } // namespace emd
 
 
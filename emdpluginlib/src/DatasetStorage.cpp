@@ -0,0 +1,889 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "DatasetStorage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include <hdf5.h>
+#include <zlib.h>
+
+#include <QByteArray>
+#include <QDebug>
+#include <QFile>
+#include <QList>
+#include <QMutexLocker>
+
+#include "DataGroup.h"
+#include "Dataset.h"
+#include "Frame.h"
+#include "FrameCache.h"
+#include "MappedFrameReader.h"
+#include "Model.h"
+#include "Trace.h"
+#include "Util.h"
+#include "WorkflowModule.h"
+#include "WorkScheduler.h"
+
+namespace emd
+{
+
+namespace
+{
+
+// What the reads need to know about a dataset, copied out of the storage
+// so that it can be used without the read lock
+struct Layout
+{
+    std::vector<hsize_t> dimensions;
+    // Empty unless the dataset is chunked
+    std::vector<hsize_t> chunk;
+    DataType type;
+    int elementBytes;
+    // Whether the chunks are compressed with deflate alone, and store the
+    // elements in native byte order
+    bool deflated;
+    // The file offset of contiguous, unfiltered datasets which store the
+    // elements in native byte order, or -1
+    int64_t mappedOffset;
+
+    Layout()
+        : type(DataTypeUInt8),
+        elementBytes(0),
+        deflated(false),
+        mappedOffset(-1)
+    {}
+};
+
+// A handle of the dataset of our own, next to emdlib's
+struct Storage
+{
+    hid_t file;
+    hid_t dataset;
+    QByteArray path;
+    Layout layout;
+    // Whether frames can be read through the handle, i.e. whether they
+    // match emdlib's frames
+    bool readable;
+
+    Storage()
+        : file(-1),
+        dataset(-1),
+        readable(false)
+    {}
+
+    ~Storage()
+    {
+        if(dataset >= 0)
+            H5Dclose(dataset);
+        if(file >= 0)
+            H5Fclose(file);
+    }
+};
+
+struct Search
+{
+    QByteArray groupName;
+    std::vector<hsize_t> dimensions;
+    QList<QByteArray> matches;
+};
+
+// The part of the dataset a frame covers: its displayed dimensions whole,
+// and one index of each of the others
+struct Region
+{
+    std::vector<hsize_t> start;
+    std::vector<hsize_t> count;
+    int hDimension;
+    int vDimension;
+};
+
+struct Chunk
+{
+    std::vector<hsize_t> offset;
+    uint32_t filterMask;
+    std::vector<char> raw;
+    std::vector<char> data;
+};
+
+typedef std::map<const Dataset *, std::unique_ptr<Storage>> StorageMap;
+
+}
+
+// Guarded by FrameCache::readMutex(), like all HDF5 calls. It is never
+// destroyed, since HDF5 shuts down at exit before static objects are, and
+// closes the handles itself.
+static StorageMap &storageMap()
+{
+    static StorageMap *storage = new StorageMap();
+
+    return *storage;
+}
+
+// Element sizes are looked up on the GUI thread, which mustn't wait for the
+// read lock
+static QMutex s_elementBytesMutex;
+static std::map<const Dataset *, int> s_elementBytes;
+
+static bool datasetDimensions(hid_t dataset, std::vector<hsize_t> &dimensions)
+{
+    hid_t space = H5Dget_space(dataset);
+    if(space < 0)
+        return false;
+
+    int rank = H5Sget_simple_extent_ndims(space);
+
+    if(rank > 0)
+    {
+        dimensions.resize(rank);
+        H5Sget_simple_extent_dims(space, dimensions.data(), NULL);
+    }
+
+    H5Sclose(space);
+
+    return rank > 0;
+}
+
+static hid_t nativeType(DataType type)
+{
+    switch(type)
+    {
+    case DataTypeInt8:
+        return H5T_NATIVE_INT8;
+    case DataTypeUInt8:
+        return H5T_NATIVE_UINT8;
+    case DataTypeInt16:
+        return H5T_NATIVE_INT16;
+    case DataTypeUInt16:
+        return H5T_NATIVE_UINT16;
+    case DataTypeInt32:
+        return H5T_NATIVE_INT32;
+    case DataTypeUInt32:
+        return H5T_NATIVE_UINT32;
+    case DataTypeInt64:
+        return H5T_NATIVE_INT64;
+    case DataTypeUInt64:
+        return H5T_NATIVE_UINT64;
+    case DataTypeFloat32:
+        return H5T_NATIVE_FLOAT;
+    case DataTypeFloat64:
+        return H5T_NATIVE_DOUBLE;
+    default:
+        return -1;
+    }
+}
+
+// EMD data groups keep their data in a dataset named "data"
+static herr_t findDataset(hid_t root, const char *name, const H5L_info_t *info, void *data)
+{
+    Search *search = static_cast<Search *>(data);
+
+    if(info->type != H5L_TYPE_HARD)
+        return 0;
+
+    QByteArray path(name);
+    QList<QByteArray> parts = path.split('/');
+
+    if(parts.count() < 2 || parts.last() != "data" || parts[parts.count() - 2] != search->groupName)
+        return 0;
+
+    hid_t dataset = H5Dopen2(root, name, H5P_DEFAULT);
+    if(dataset < 0)
+        return 0;
+
+    std::vector<hsize_t> dimensions;
+    if(datasetDimensions(dataset, dimensions) && dimensions == search->dimensions)
+        search->matches.append(path);
+
+    H5Dclose(dataset);
+
+    return 0;
+}
+
+static std::unique_ptr<Storage> openStorage(const DataGroup *dataGroup)
+{
+    std::unique_ptr<Storage> storage(new Storage());
+
+    storage->file = H5Fopen(QFile::encodeName(dataGroup->model()->filePath()).constData(),
+                            H5F_ACC_RDONLY, H5P_DEFAULT);
+    if(storage->file < 0)
+        return std::unique_ptr<Storage>();
+
+    Search search;
+    search.groupName = dataGroup->name().toUtf8();
+
+    for(int index = 0; index < dataGroup->dimCount(); ++index)
+        search.dimensions.push_back((hsize_t) dataGroup->dimData(index)->dimLength(0));
+
+    H5Lvisit(storage->file, H5_INDEX_NAME, H5_ITER_NATIVE, findDataset, &search);
+
+    // Data groups of the same name and shape can't be told apart
+    if(search.matches.count() != 1)
+        return std::unique_ptr<Storage>();
+
+    storage->dataset = H5Dopen2(storage->file, search.matches.first().constData(), H5P_DEFAULT);
+    if(storage->dataset < 0)
+        return std::unique_ptr<Storage>();
+
+    storage->path = search.matches.first();
+    storage->layout.dimensions = search.dimensions;
+
+    return storage;
+}
+
+// Reads the chunk shape and filters from the dataset's creation properties
+static void readLayout(hid_t dataset, Layout &layout)
+{
+    hid_t plist = H5Dget_create_plist(dataset);
+    if(plist < 0)
+        return;
+
+    H5D_layout_t storageLayout = H5Pget_layout(plist);
+
+    if(storageLayout == H5D_CONTIGUOUS && H5Pget_nfilters(plist) == 0)
+    {
+        // Undefined until the dataset has been written
+        haddr_t offset = H5Dget_offset(dataset);
+
+        if(offset != HADDR_UNDEF)
+            layout.mappedOffset = (int64_t) offset;
+    }
+    else if(storageLayout == H5D_CHUNKED)
+    {
+        int rank = (int) layout.dimensions.size();
+        std::vector<hsize_t> chunk(rank);
+
+        if(H5Pget_chunk(plist, rank, chunk.data()) == rank)
+            layout.chunk = chunk;
+
+        unsigned int flags = 0;
+        size_t valueCount = 0;
+
+        layout.deflated = !layout.chunk.empty() && H5Pget_nfilters(plist) == 1
+            && H5Pget_filter2(plist, 0, &flags, &valueCount, NULL, 0, NULL, NULL)
+                == H5Z_FILTER_DEFLATE;
+    }
+
+    H5Pclose(plist);
+}
+
+static bool sliceRegion(const Layout &layout, const Dataset::Slice &slice, Region &region)
+{
+    int rank = (int) layout.dimensions.size();
+
+    if((int) slice.size() != rank)
+        return false;
+
+    region.start.assign(rank, 0);
+    region.count.assign(rank, 1);
+    region.hDimension = -1;
+    region.vDimension = -1;
+
+    for(int index = 0; index < rank; ++index)
+    {
+        if(slice[index] == Dataset::HorizontalDimension || slice[index] == Dataset::VerticalDimension)
+        {
+            if(slice[index] == Dataset::HorizontalDimension)
+                region.hDimension = index;
+            else
+                region.vDimension = index;
+
+            region.count[index] = layout.dimensions[index];
+        }
+        else if(slice[index] < 0 || (hsize_t) slice[index] >= layout.dimensions[index])
+        {
+            return false;
+        }
+        else
+        {
+            region.start[index] = (hsize_t) slice[index];
+        }
+    }
+
+    return region.hDimension >= 0 && region.vDimension >= 0;
+}
+
+// Frames are read in C order over their two dimensions, so the later of the
+// two in the file is the contiguous one. The frame keeps the block alive.
+static std::shared_ptr<Frame> blockFrame(const Layout &layout, const Region &region,
+                                         const std::shared_ptr<std::vector<char>> &block,
+                                         int64_t offset)
+{
+    int hSize = (int) layout.dimensions[region.hDimension];
+    int vSize = (int) layout.dimensions[region.vDimension];
+
+    bool hContiguous = region.hDimension > region.vDimension;
+
+    Frame::Data<void> data(0, hContiguous ? 1 : vSize, hContiguous ? hSize : 1, hSize, vSize,
+                           block->data() + offset, nullptr);
+
+    return std::shared_ptr<Frame>(new Frame(data, layout.type, false),
+        [block](Frame *frame) { delete frame; });
+}
+
+// Copies the part of a decompressed chunk which falls into the frame's region
+static void copyChunk(const Layout &layout, const Region &region, const Chunk &chunk, char *frame)
+{
+    int rank = (int) layout.dimensions.size();
+
+    // The frame's two dimensions, in file order
+    int outer = std::min(region.hDimension, region.vDimension);
+    int inner = std::max(region.hDimension, region.vDimension);
+
+    int64_t frameStride = (int64_t) layout.dimensions[inner];
+
+    // In elements, C order over the chunk
+    std::vector<int64_t> chunkStrides(rank);
+    int64_t stride = 1;
+    for(int index = rank - 1; index >= 0; --index)
+    {
+        chunkStrides[index] = stride;
+        stride *= (int64_t) layout.chunk[index];
+    }
+
+    int64_t base = 0;
+    for(int index = 0; index < rank; ++index)
+    {
+        if(index != outer && index != inner)
+            base += (int64_t) (region.start[index] - chunk.offset[index]) * chunkStrides[index];
+    }
+
+    // Edge chunks reach past the end of the dataset
+    hsize_t outerEnd = std::min(chunk.offset[outer] + layout.chunk[outer], layout.dimensions[outer]);
+    hsize_t innerEnd = std::min(chunk.offset[inner] + layout.chunk[inner], layout.dimensions[inner]);
+    int64_t innerCount = (int64_t) (innerEnd - chunk.offset[inner]);
+
+    int elementBytes = layout.elementBytes;
+
+    for(hsize_t outerIndex = chunk.offset[outer]; outerIndex < outerEnd; ++outerIndex)
+    {
+        const char *source = chunk.data.data() + (base
+            + (int64_t) (outerIndex - chunk.offset[outer]) * chunkStrides[outer]) * elementBytes;
+        char *target = frame + ((int64_t) outerIndex * frameStride
+            + (int64_t) chunk.offset[inner]) * elementBytes;
+
+        if(chunkStrides[inner] == 1)
+        {
+            memcpy(target, source, innerCount * elementBytes);
+        }
+        else
+        {
+            for(int64_t innerIndex = 0; innerIndex < innerCount; ++innerIndex)
+            {
+                memcpy(target + innerIndex * elementBytes,
+                       source + innerIndex * chunkStrides[inner] * elementBytes, elementBytes);
+            }
+        }
+    }
+}
+
+// Fetches the raw chunks of the frames under the read lock, then releases
+// it and decompresses the chunks in parallel, each one once per batch.
+// Returns false, having read nothing and with the lock held again, if a
+// chunk isn't stored or can't be decompressed.
+static bool readChunks(hid_t dataset, const Layout &layout, const std::vector<Region> &regions,
+                       std::vector<std::shared_ptr<Frame>> &frames, int priority,
+                       QMutexLocker &locker)
+{
+    int rank = (int) layout.dimensions.size();
+
+    // The chunks each frame touches, and the index of every chunk in chunks
+    std::map<std::vector<hsize_t>, int> chunkIndices;
+    std::vector<Chunk> chunks;
+    std::vector<std::vector<int>> frameChunks(regions.size());
+
+    for(size_t frame = 0; frame < regions.size(); ++frame)
+    {
+        const Region &region = regions[frame];
+
+        int outer = std::min(region.hDimension, region.vDimension);
+        int inner = std::max(region.hDimension, region.vDimension);
+
+        std::vector<hsize_t> offset(rank);
+        for(int index = 0; index < rank; ++index)
+            offset[index] = region.start[index] / layout.chunk[index] * layout.chunk[index];
+
+        for(hsize_t outerOffset = 0; outerOffset < layout.dimensions[outer];
+            outerOffset += layout.chunk[outer])
+        {
+            for(hsize_t innerOffset = 0; innerOffset < layout.dimensions[inner];
+                innerOffset += layout.chunk[inner])
+            {
+                offset[outer] = outerOffset;
+                offset[inner] = innerOffset;
+
+                auto it = chunkIndices.find(offset);
+                if(it == chunkIndices.end())
+                {
+                    it = chunkIndices.insert(std::make_pair(offset, (int) chunks.size())).first;
+
+                    chunks.push_back(Chunk());
+                    chunks.back().offset = offset;
+                }
+
+                frameChunks[frame].push_back(it->second);
+            }
+        }
+    }
+
+    {
+        EMD_TRACE_ZONE("DatasetStorage::readChunks");
+
+        for(Chunk &chunk : chunks)
+        {
+            hsize_t bytes = 0;
+
+            if(H5Dget_chunk_storage_size(dataset, chunk.offset.data(), &bytes) < 0 || bytes == 0)
+                return false;
+
+            chunk.raw.resize(bytes);
+
+            if(H5Dread_chunk(dataset, H5P_DEFAULT, chunk.offset.data(), &chunk.filterMask,
+                             chunk.raw.data()) < 0)
+                return false;
+        }
+    }
+
+    locker.unlock();
+
+    int64_t chunkBytes = layout.elementBytes;
+    for(hsize_t extent : layout.chunk)
+        chunkBytes *= (int64_t) extent;
+
+    std::atomic<bool> failed(false);
+
+    WorkScheduler::instance().runTiles(priority, (int) chunks.size(),
+        [&](int tile)
+    {
+        EMD_TRACE_ZONE("DatasetStorage::decompress");
+
+        Chunk &chunk = chunks[tile];
+
+        // A set bit in the mask means the filter was skipped for this chunk
+        if(chunk.filterMask & 1)
+        {
+            chunk.data.swap(chunk.raw);
+        }
+        else
+        {
+            chunk.data.resize(chunkBytes);
+
+            uLongf length = (uLongf) chunkBytes;
+            if(uncompress((Bytef *) chunk.data.data(), &length, (const Bytef *) chunk.raw.data(),
+                          (uLong) chunk.raw.size()) != Z_OK)
+                failed.store(true);
+
+            chunk.raw = std::vector<char>();
+        }
+
+        if((int64_t) chunk.data.size() < chunkBytes)
+            failed.store(true);
+    });
+
+    if(failed.load())
+    {
+        qWarning() << "Failed to decompress a chunk; the frames are read through HDF5 instead.";
+
+        locker.relock();
+        return false;
+    }
+
+    int64_t frameBytes = (int64_t) layout.elementBytes;
+    if(!regions.empty())
+    {
+        frameBytes *= (int64_t) layout.dimensions[regions[0].hDimension]
+            * (int64_t) layout.dimensions[regions[0].vDimension];
+    }
+
+    for(size_t frame = 0; frame < regions.size(); ++frame)
+    {
+        std::shared_ptr<std::vector<char>> block = std::make_shared<std::vector<char>>(frameBytes);
+
+        for(int index : frameChunks[frame])
+            copyChunk(layout, regions[frame], chunks[index], block->data());
+
+        frames[frame] = blockFrame(layout, regions[frame], block, 0);
+    }
+
+    return true;
+}
+
+// The dimension along which regions[first + 1] follows regions[first], or -1
+// if it doesn't follow it by one index of a single dimension
+static int runDimension(const std::vector<Region> &regions, size_t first)
+{
+    if(first + 1 >= regions.size())
+        return -1;
+
+    const Region &region = regions[first];
+    const Region &next = regions[first + 1];
+
+    if(next.hDimension != region.hDimension || next.vDimension != region.vDimension)
+        return -1;
+
+    int dimension = -1;
+
+    for(size_t index = 0; index < region.start.size(); ++index)
+    {
+        if(next.start[index] == region.start[index])
+            continue;
+
+        if(dimension >= 0 || next.start[index] != region.start[index] + 1)
+            return -1;
+
+        dimension = (int) index;
+    }
+
+    return dimension;
+}
+
+// Reads runs of frames which follow one another along a single dimension
+// with one hyperslab selection each, through the dataset's chunk cache
+static void readRegions(hid_t dataset, const Layout &layout, const std::vector<Region> &regions,
+                        std::vector<std::shared_ptr<Frame>> &frames)
+{
+    EMD_TRACE_ZONE("DatasetStorage::readRegions");
+
+    hid_t fileSpace = H5Dget_space(dataset);
+    if(fileSpace < 0)
+        return;
+
+    int rank = (int) layout.dimensions.size();
+    int elementBytes = layout.elementBytes;
+
+    size_t first = 0;
+
+    while(first < regions.size())
+    {
+        const Region &region = regions[first];
+
+        int dimension = runDimension(regions, first);
+        size_t length = 1;
+
+        while(dimension >= 0 && first + length < regions.size()
+              && runDimension(regions, first + length - 1) == dimension)
+        {
+            ++length;
+        }
+
+        std::vector<hsize_t> count = region.count;
+        if(dimension >= 0)
+            count[dimension] = length;
+
+        int outer = std::min(region.hDimension, region.vDimension);
+        int inner = std::max(region.hDimension, region.vDimension);
+
+        // In elements, C order over the selection, which is the order
+        // H5Dread() fills the block in
+        std::vector<int64_t> strides(rank);
+        int64_t stride = 1;
+        for(int index = rank - 1; index >= 0; --index)
+        {
+            strides[index] = stride;
+            stride *= (int64_t) count[index];
+        }
+
+        hsize_t elements = (hsize_t) stride;
+        hid_t memorySpace = H5Screate_simple(1, &elements, NULL);
+
+        std::shared_ptr<std::vector<char>> block
+            = std::make_shared<std::vector<char>>(elements * elementBytes);
+
+        if(H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, region.start.data(), NULL,
+                               count.data(), NULL) >= 0
+           && H5Dread(dataset, nativeType(layout.type), memorySpace, fileSpace, H5P_DEFAULT,
+                      block->data()) >= 0)
+        {
+            int64_t frameElements = (int64_t) count[outer] * (int64_t) count[inner];
+
+            // Frames ahead of the run's dimension are whole within the block
+            // and share it. Otherwise they are interleaved, and each is
+            // copied out on its own.
+            if(dimension < 0 || dimension < outer)
+            {
+                for(size_t frame = 0; frame < length; ++frame)
+                {
+                    frames[first + frame] = blockFrame(layout, regions[first + frame], block,
+                        (int64_t) frame * frameElements * elementBytes);
+                }
+            }
+            else
+            {
+                for(size_t frame = 0; frame < length; ++frame)
+                {
+                    std::shared_ptr<std::vector<char>> frameBlock
+                        = std::make_shared<std::vector<char>>(frameElements * elementBytes);
+
+                    const char *source = block->data()
+                        + (int64_t) frame * strides[dimension] * elementBytes;
+                    char *target = frameBlock->data();
+
+                    for(hsize_t outerIndex = 0; outerIndex < count[outer]; ++outerIndex)
+                    {
+                        for(hsize_t innerIndex = 0; innerIndex < count[inner]; ++innerIndex)
+                        {
+                            memcpy(target, source + ((int64_t) outerIndex * strides[outer]
+                                   + (int64_t) innerIndex * strides[inner]) * elementBytes,
+                                   elementBytes);
+                            target += elementBytes;
+                        }
+                    }
+
+                    frames[first + frame] = blockFrame(layout, regions[first + frame], frameBlock, 0);
+                }
+            }
+        }
+
+        H5Sclose(memorySpace);
+
+        first += length;
+    }
+
+    H5Sclose(fileSpace);
+}
+
+// Whether chunks hold several frames, which the chunk cache keeps
+// decompressed from one read to the next
+static bool chunksSpanFrames(const Layout &layout, const Region &region)
+{
+    for(size_t index = 0; index < layout.chunk.size(); ++index)
+    {
+        if((int) index != region.hDimension && (int) index != region.vDimension
+           && layout.chunk[index] > 1)
+            return true;
+    }
+
+    return false;
+}
+
+// The FrameCache's reader
+static void readFrames(const Dataset *dataset, const std::vector<Dataset::Slice> &slices,
+                       std::vector<std::shared_ptr<Frame>> &frames, int priority)
+{
+    QMutexLocker locker(&FrameCache::readMutex());
+
+    auto it = storageMap().find(dataset);
+    if(it == storageMap().end() || !it->second->readable)
+        return;
+
+    const Storage &storage = *it->second;
+    Layout layout = storage.layout;
+
+    if(slices.empty())
+        return;
+
+    std::vector<Region> regions(slices.size());
+    for(size_t index = 0; index < slices.size(); ++index)
+    {
+        if(!sliceRegion(layout, slices[index], regions[index]))
+            return;
+    }
+
+    // Chunks are fetched raw when every chunk is decompressed once per
+    // batch anyway. Single frames from chunks which span several frames
+    // are better served by the chunk cache, and other filters and layouts
+    // are only read through it.
+    if(layout.deflated && (slices.size() > 1 || !chunksSpanFrames(layout, regions[0])))
+    {
+        if(readChunks(storage.dataset, layout, regions, frames, priority, locker))
+            return;
+
+        // The dataset may have been detached while the lock was released
+        it = storageMap().find(dataset);
+        if(it == storageMap().end())
+            return;
+    }
+
+    readRegions(it->second->dataset, layout, regions, frames);
+}
+
+// The FrameCache's chunk cache handler. HDF5 only takes the chunk cache
+// size when a dataset is opened, so the handle is reopened.
+static bool setChunkCache(const Dataset *dataset, int64_t bytes, int slots)
+{
+    QMutexLocker locker(&FrameCache::readMutex());
+
+    auto it = storageMap().find(dataset);
+    if(it == storageMap().end())
+        return false;
+
+    Storage &storage = *it->second;
+
+    hid_t plist = H5Pcreate(H5P_DATASET_ACCESS);
+    if(plist < 0)
+        return false;
+
+    H5Pset_chunk_cache(plist, (size_t) slots, (size_t) bytes, H5D_CHUNK_CACHE_W0_DEFAULT);
+
+    hid_t handle = H5Dopen2(storage.file, storage.path.constData(), plist);
+
+    H5Pclose(plist);
+
+    if(handle < 0)
+        return false;
+
+    H5Dclose(storage.dataset);
+    storage.dataset = handle;
+
+    return true;
+}
+
+// Checks the dataset against emdlib's frame of the default slice, and finds
+// the element type of the frames. Datasets which aren't read as plain
+// frames, e.g. complex ones, are left to emdlib.
+static bool checkFrames(const Dataset *dataset, Storage &storage)
+{
+    std::unique_ptr<Frame> reference(dataset->frame(dataset->defaultSlice()));
+
+    Region region;
+    if(!reference || reference->isComplex()
+       || !sliceRegion(storage.layout, dataset->defaultSlice(), region))
+        return false;
+
+    Frame::Data<void> data = reference->data<void>();
+    if((hsize_t) data.hSize != storage.layout.dimensions[region.hDimension]
+       || (hsize_t) data.vSize != storage.layout.dimensions[region.vDimension])
+        return false;
+
+    DataType type = reference->dataType();
+    hid_t memoryType = nativeType(type);
+    if(memoryType < 0)
+        return false;
+
+    storage.layout.type = type;
+    storage.layout.elementBytes = emdTypeDepth(type);
+
+    // Raw chunks and mapped data are used as they are stored
+    hid_t fileType = H5Dget_type(storage.dataset);
+    if(fileType < 0 || H5Tequal(fileType, memoryType) <= 0)
+    {
+        storage.layout.deflated = false;
+        storage.layout.mappedOffset = -1;
+    }
+    if(fileType >= 0)
+        H5Tclose(fileType);
+
+    return true;
+}
+
+bool DatasetStorage::attach(const DataGroup *dataGroup)
+{
+    const Dataset *dataset = dataGroup->data();
+
+    std::vector<int64_t> shape;
+    std::vector<int64_t> dimensions;
+    int64_t mappedOffset = -1;
+    DataType type = DataTypeUInt8;
+
+    {
+        QMutexLocker locker(&FrameCache::readMutex());
+
+        // Misses in the search aren't errors
+        H5E_auto2_t errorFunction;
+        void *errorData;
+        H5Eget_auto2(H5E_DEFAULT, &errorFunction, &errorData);
+        H5Eset_auto2(H5E_DEFAULT, NULL, NULL);
+
+        std::unique_ptr<Storage> storage = openStorage(dataGroup);
+
+        H5Eset_auto2(H5E_DEFAULT, errorFunction, errorData);
+
+        if(!storage)
+        {
+            qDebug() << "The storage of data group" << dataGroup->name() << "wasn't found;"
+                << "it is read through emdlib alone.";
+            return false;
+        }
+
+        readLayout(storage->dataset, storage->layout);
+        storage->readable = checkFrames(dataset, *storage);
+
+        shape.assign(storage->layout.chunk.begin(), storage->layout.chunk.end());
+
+        if(storage->readable)
+        {
+            dimensions.assign(storage->layout.dimensions.begin(), storage->layout.dimensions.end());
+            mappedOffset = storage->layout.mappedOffset;
+            type = storage->layout.type;
+        }
+
+        storageMap()[dataset] = std::move(storage);
+    }
+
+    // The type is only known for datasets which are read as plain frames
+    if(!dimensions.empty())
+    {
+        QMutexLocker locker(&s_elementBytesMutex);
+        s_elementBytes[dataset] = emdTypeDepth(type);
+    }
+
+    // Mapped frames are served before the reader is asked
+    if(mappedOffset >= 0)
+    {
+        MappedFrameReader::instance().addDataset(dataset, dataGroup->model()->filePath(),
+                                                 mappedOffset, dimensions, type);
+    }
+
+    FrameCache &cache = FrameCache::instance();
+
+    // One reader and handler serve all datasets
+    static bool s_installed = false;
+    if(!s_installed)
+    {
+        cache.setReader(readFrames);
+        cache.setChunkCacheHandler(setChunkCache);
+        s_installed = true;
+    }
+
+    cache.setChunkShape(dataset, shape);
+
+    return true;
+}
+
+void DatasetStorage::detach(const Dataset *dataset)
+{
+    {
+        QMutexLocker locker(&s_elementBytesMutex);
+        s_elementBytes.erase(dataset);
+    }
+
+    QMutexLocker locker(&FrameCache::readMutex());
+
+    storageMap().erase(dataset);
+}
+
+int DatasetStorage::elementBytes(const Dataset *dataset)
+{
+    QMutexLocker locker(&s_elementBytesMutex);
+
+    auto it = s_elementBytes.find(dataset);
+    if(it == s_elementBytes.end())
+        return 0;
+
+    return it->second;
+}
+
+} // namespace emd
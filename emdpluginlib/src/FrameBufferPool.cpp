@@ -0,0 +1,227 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "FrameBufferPool.h"
+
+#include <QDebug>
+#include <QtGlobal>
+
+namespace emd
+{
+
+// Wide enough for AVX-512 loads, and a cache line
+static const int kAlignment = 64;
+
+static const int64_t kMinBufferSize = 4096;
+static const int64_t kDefaultIdleLimit = 256 * 1024 * 1024;
+
+namespace
+{
+
+struct ImageBuffer
+{
+    std::weak_ptr<FrameBufferPool> pool;
+    void *buffer;
+};
+
+void releaseImageBuffer(void *info)
+{
+    ImageBuffer *imageBuffer = static_cast<ImageBuffer *>(info);
+
+    FrameBufferPool::release(imageBuffer->pool, imageBuffer->buffer);
+
+    delete imageBuffer;
+}
+
+} // namespace
+
+FrameBufferPool::FrameBufferPool()
+    : m_idleLimit(kDefaultIdleLimit)
+{
+}
+
+FrameBufferPool::~FrameBufferPool()
+{
+    trim();
+
+    // Buffers still in use are freed by their owners
+}
+
+int64_t FrameBufferPool::sizeClass(int64_t bytes)
+{
+    if(bytes <= kMinBufferSize)
+        return kMinBufferSize;
+
+    int64_t size = kMinBufferSize;
+    while(size < bytes)
+        size *= 2;
+
+    // Quarter steps between the two powers of two waste less than a quarter
+    int64_t step = size / 8;
+    int64_t capacity = size / 2;
+
+    while(capacity < bytes)
+        capacity += step;
+
+    return capacity;
+}
+
+void *FrameBufferPool::acquire(int64_t bytes)
+{
+    int64_t capacity = sizeClass(bytes);
+    void *buffer = nullptr;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        ++m_statistics.requests;
+
+        auto it = m_idle.find(capacity);
+        if(it != m_idle.end() && !it->second.empty())
+        {
+            buffer = it->second.back();
+            it->second.pop_back();
+
+            ++m_statistics.reuses;
+            m_statistics.idleBytes -= capacity;
+        }
+    }
+
+    if(!buffer)
+    {
+        buffer = qMallocAligned((size_t) capacity, kAlignment);
+
+        if(!buffer)
+        {
+            qCritical() << "Failed to allocate a frame buffer of" << capacity << "bytes";
+            return nullptr;
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    m_inUse[buffer] = capacity;
+
+    m_statistics.bytesInUse += capacity;
+    if(m_statistics.bytesInUse > m_statistics.peakBytes)
+        m_statistics.peakBytes = m_statistics.bytesInUse;
+
+    return buffer;
+}
+
+void FrameBufferPool::release(void *buffer)
+{
+    if(!buffer)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        auto it = m_inUse.find(buffer);
+
+        // Buffers from the heap, e.g. allocated before the module joined
+        // the workflow, go back to it
+        if(it != m_inUse.end())
+        {
+            int64_t capacity = it->second;
+            m_inUse.erase(it);
+
+            m_statistics.bytesInUse -= capacity;
+
+            if(m_statistics.idleBytes + capacity <= m_idleLimit)
+            {
+                m_idle[capacity].push_back(buffer);
+                m_statistics.idleBytes += capacity;
+                return;
+            }
+        }
+    }
+
+    qFreeAligned(buffer);
+}
+
+void FrameBufferPool::release(const std::weak_ptr<FrameBufferPool> &pool, void *buffer)
+{
+    std::shared_ptr<FrameBufferPool> owner = pool.lock();
+
+    if(owner)
+        owner->release(buffer);
+    else
+        qFreeAligned(buffer);
+}
+
+QImage *FrameBufferPool::image(int width, int height, QImage::Format format)
+{
+    // The scan lines of 32-bit formats are aligned like those QImage
+    // allocates
+    int bytesPerLine = ((width * QImage::toPixelFormat(format).bitsPerPixel() + 31) / 32) * 4;
+
+    void *buffer = acquire((int64_t) bytesPerLine * height);
+    if(!buffer)
+        return new QImage(width, height, format);
+
+    ImageBuffer *info = new ImageBuffer;
+    info->pool = shared_from_this();
+    info->buffer = buffer;
+
+    return new QImage((uchar *) buffer, width, height, bytesPerLine, format,
+                      releaseImageBuffer, info);
+}
+
+int64_t FrameBufferPool::idleLimit() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_idleLimit;
+}
+
+void FrameBufferPool::setIdleLimit(int64_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_idleLimit = bytes;
+}
+
+void FrameBufferPool::trim()
+{
+    std::map<int64_t, std::vector<void *>> idle;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        idle.swap(m_idle);
+        m_statistics.idleBytes = 0;
+    }
+
+    for(auto &sizeClass : idle)
+    {
+        for(void *buffer : sizeClass.second)
+            qFreeAligned(buffer);
+    }
+}
+
+FrameBufferPool::Statistics FrameBufferPool::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_statistics;
+}
+
+} // namespace emd
@@ -0,0 +1,520 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "FrameCache.h"
+
+#include <algorithm>
+
+#include <QMutexLocker>
+#include <QSettings>
+
+#include "DataGroup.h"
+#include "DatasetStorage.h"
+#include "Frame.h"
+#include "MappedFrameReader.h"
+#include "Trace.h"
+#include "Util.h"
+#include "WorkflowModule.h"
+
+namespace emd
+{
+
+static const int kDefaultBudget = 512;  // MB
+static const int kDefaultChunkCacheLimit = 256;  // MB
+
+// HDF5 recommends about 100 hash slots per chunk that fits in the cache,
+// and a prime slot count.
+static const int kSlotsPerChunk = 100;
+
+static int nextPrime(int64_t value)
+{
+    if(value <= 2)
+        return 2;
+
+    for(int64_t candidate = value | 1; ; candidate += 2)
+    {
+        bool prime = true;
+        for(int64_t divisor = 3; divisor * divisor <= candidate; divisor += 2)
+        {
+            if(candidate % divisor == 0)
+            {
+                prime = false;
+                break;
+            }
+        }
+
+        if(prime)
+            return (int) candidate;
+    }
+}
+
+// The HDF5 library is not built thread-safe, so reads from different
+// workflows must not overlap. Recursive, since the GUI thread holds it
+// around emdlib calls which may reach the cache through Qt signals.
+static QMutex s_readMutex(QMutex::Recursive);
+
+FrameCache &FrameCache::instance()
+{
+    static FrameCache cache;
+
+    return cache;
+}
+
+int64_t FrameCache::frameBytes(const Frame *frame)
+{
+    if(!frame)
+        return 0;
+
+    int64_t bytes = (int64_t) frame->data<void>().size() * emdTypeDepth(frame->dataType());
+
+    if(frame->isComplex())
+        bytes *= 2;
+
+    return bytes;
+}
+
+FrameCache::FrameCache()
+    : m_bytes(0),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0),
+    m_chunkHits(0),
+    m_chunkMisses(0)
+{
+    QSettings settings;
+    m_budget = settings.value("Preferences/FrameCacheSize", kDefaultBudget).toLongLong()
+        * 1024 * 1024;
+    m_chunkCacheLimit = settings.value("Preferences/ChunkCacheLimit", kDefaultChunkCacheLimit)
+        .toLongLong() * 1024 * 1024;
+}
+
+int64_t FrameCache::budget() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_budget;
+}
+
+void FrameCache::setBudget(int64_t bytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_budget = std::max<int64_t>(bytes, 0);
+
+    evict();
+}
+
+std::shared_ptr<Frame> FrameCache::frame(const Dataset *dataset, const Dataset::Slice &slice,
+                                         int priority)
+{
+    std::vector<std::shared_ptr<Frame>> result;
+    frames(dataset, std::vector<Dataset::Slice>(1, slice), result, priority);
+
+    return result[0];
+}
+
+void FrameCache::frames(const Dataset *dataset, const std::vector<Dataset::Slice> &slices,
+                        std::vector<std::shared_ptr<Frame>> &frames, int priority)
+{
+    // Mapped frames cost no memory and no I/O up front, so they bypass the
+    // cache altogether.
+    MappedFrameReader &mapped = MappedFrameReader::instance();
+
+    if(mapped.contains(dataset))
+    {
+        frames.resize(slices.size());
+
+        bool complete = true;
+        for(size_t index = 0; index < slices.size(); ++index)
+        {
+            frames[index] = mapped.frame(dataset, slices[index]);
+            complete = complete && frames[index];
+        }
+
+        if(complete)
+            return;
+    }
+
+    frames.assign(slices.size(), std::shared_ptr<Frame>());
+
+    std::vector<Key> keys;
+    keys.reserve(slices.size());
+
+    std::vector<size_t> misses;
+    std::vector<int64_t> shape;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        auto shapeIt = m_chunkShapes.find(dataset);
+        if(shapeIt != m_chunkShapes.end())
+            shape = shapeIt->second;
+
+        for(size_t index = 0; index < slices.size(); ++index)
+        {
+            keys.push_back(key(dataset, slices[index]));
+
+            auto it = m_entries.find(keys.back());
+            if(it != m_entries.end())
+            {
+                ++m_hits;
+
+                m_uses.splice(m_uses.begin(), m_uses, it->second.use);
+
+                frames[index] = it->second.frame;
+            }
+            else
+            {
+                ++m_misses;
+
+                misses.push_back(index);
+            }
+        }
+    }
+
+    if(misses.empty())
+        return;
+
+    // Reads which share a chunk are made adjacent, keeping the given order
+    // within each chunk.
+    std::vector<std::vector<int64_t>> chunks;
+
+    if(!shape.empty())
+    {
+        chunks.resize(slices.size());
+        for(size_t index : misses)
+            chunks[index] = chunkIndex(slices[index], shape);
+
+        std::stable_sort(misses.begin(), misses.end(),
+            [&chunks](size_t a, size_t b) { return chunks[a] < chunks[b]; });
+    }
+
+    // Read without holding the cache lock, so that hits on other threads
+    // aren't held up by the I/O. Two threads missing on the same slice both
+    // read it, and the first insert wins.
+    Reader reader;
+    {
+        QMutexLocker locker(&m_mutex);
+        reader = m_reader;
+    }
+
+    std::vector<size_t> fallbacks;
+
+    if(reader)
+    {
+        EMD_TRACE_ZONE("FrameCache::readDirect");
+
+        std::vector<Dataset::Slice> missed;
+        missed.reserve(misses.size());
+
+        for(size_t index : misses)
+            missed.push_back(slices[index]);
+
+        std::vector<std::shared_ptr<Frame>> read(missed.size());
+        reader(dataset, missed, read, priority);
+
+        for(size_t miss = 0; miss < misses.size(); ++miss)
+        {
+            frames[misses[miss]] = read[miss];
+
+            if(!read[miss])
+                fallbacks.push_back(misses[miss]);
+        }
+    }
+    else
+    {
+        fallbacks = misses;
+    }
+
+    if(!fallbacks.empty())
+    {
+        EMD_TRACE_ZONE("FrameCache::read");
+
+        QMutexLocker locker(&s_readMutex);
+
+        for(size_t index : fallbacks)
+            frames[index].reset(dataset->frame(slices[index]));
+    }
+
+    if(!shape.empty())
+    {
+        int64_t chunkHits = 0;
+        for(size_t miss = 1; miss < misses.size(); ++miss)
+        {
+            if(chunks[misses[miss]] == chunks[misses[miss - 1]])
+                ++chunkHits;
+        }
+
+        QMutexLocker locker(&m_mutex);
+        m_chunkHits += chunkHits;
+        m_chunkMisses += (int64_t) misses.size() - chunkHits;
+    }
+
+    for(size_t index : misses)
+    {
+        if(frames[index])
+            insert(keys[index], frames[index]);
+    }
+}
+
+bool FrameCache::contains(const Dataset *dataset, const Dataset::Slice &slice) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_entries.find(key(dataset, slice)) != m_entries.end();
+}
+
+void FrameCache::setReader(const Reader &reader)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_reader = reader;
+}
+
+QMutex &FrameCache::readMutex()
+{
+    return s_readMutex;
+}
+
+std::vector<int64_t> FrameCache::chunkShape(const Dataset *dataset) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto it = m_chunkShapes.find(dataset);
+    if(it == m_chunkShapes.end())
+        return std::vector<int64_t>();
+
+    return it->second;
+}
+
+void FrameCache::setChunkShape(const Dataset *dataset, const std::vector<int64_t> &shape)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(shape.empty())
+        m_chunkShapes.erase(dataset);
+    else
+        m_chunkShapes[dataset] = shape;
+}
+
+void FrameCache::setChunkCacheHandler(const ChunkCacheHandler &handler)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_chunkCacheHandler = handler;
+}
+
+int64_t FrameCache::tuneChunkCache(const Dataset *dataset, const std::vector<int64_t> &dimensions,
+                                   const FrameSet::Selection &selection, int elementBytes)
+{
+    QMutexLocker locker(&m_mutex);
+
+    ChunkCacheHandler handler = m_chunkCacheHandler;
+
+    auto shapeIt = m_chunkShapes.find(dataset);
+    if(!handler || shapeIt == m_chunkShapes.end())
+        return 0;
+
+    const std::vector<int64_t> &shape = shapeIt->second;
+    if(shape.size() != dimensions.size() || shape.size() != selection.size())
+        return 0;
+
+    // A frame covers the displayed dimensions whole, and one index of each
+    // of the others.
+    int64_t chunkBytes = elementBytes;
+    int64_t chunkCount = 1;
+
+    for(size_t dimIndex = 0; dimIndex < shape.size(); ++dimIndex)
+    {
+        if(shape[dimIndex] <= 0)
+            return 0;
+
+        chunkBytes *= shape[dimIndex];
+
+        if(FrameSet::isDisplayRole(selection[dimIndex].role))
+            chunkCount *= (dimensions[dimIndex] + shape[dimIndex] - 1) / shape[dimIndex];
+    }
+
+    int64_t used = 0;
+    for(auto it = m_chunkCacheSizes.begin(); it != m_chunkCacheSizes.end(); ++it)
+    {
+        if(it->first != dataset)
+            used += it->second;
+    }
+
+    // A cache which can't hold a single chunk is no better than the default
+    int64_t bytes = std::min(chunkCount * chunkBytes, m_chunkCacheLimit - used);
+    if(bytes < chunkBytes)
+        return 0;
+
+    int slots = nextPrime(bytes / chunkBytes * kSlotsPerChunk);
+
+    // The handler may call back into the cache. Tuning happens as data
+    // groups are loaded, on the GUI thread, so the budget can't be taken
+    // by another dataset in the meantime.
+    locker.unlock();
+
+    if(!handler(dataset, bytes, slots))
+        return 0;
+
+    locker.relock();
+
+    m_chunkCacheSizes[dataset] = bytes;
+
+    return bytes;
+}
+
+int64_t FrameCache::tuneChunkCache(DataGroup *dataGroup)
+{
+    const Dataset *dataset = dataGroup->data();
+
+    if(chunkShape(dataset).empty())
+        return 0;
+
+    Dataset::Slice slice = dataset->defaultSlice();
+
+    // Called on the GUI thread, when the user opens the data group
+    std::shared_ptr<Frame> frame = this->frame(dataset, slice, WorkflowModule::PriorityInteractive);
+    if(!frame)
+        return 0;
+
+    std::vector<int64_t> dimensions;
+    for(int index = 0; index < dataGroup->dimCount(); ++index)
+        dimensions.push_back(dataGroup->dimData(index)->dimLength(0));
+
+    return tuneChunkCache(dataset, dimensions, FrameSet::Selection(slice),
+                          emdTypeDepth(frame->dataType()));
+}
+
+void FrameCache::remove(const Dataset *dataset)
+{
+    DatasetStorage::detach(dataset);
+
+    QMutexLocker locker(&m_mutex);
+
+    m_chunkShapes.erase(dataset);
+    m_chunkCacheSizes.erase(dataset);
+
+    MappedFrameReader::instance().removeDataset(dataset);
+
+    auto it = m_entries.lower_bound(Key(dataset, std::vector<int64_t>()));
+
+    while(it != m_entries.end() && it->first.first == dataset)
+    {
+        m_bytes -= it->second.bytes;
+        m_uses.erase(it->second.use);
+
+        it = m_entries.erase(it);
+    }
+}
+
+void FrameCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_entries.clear();
+    m_uses.clear();
+    m_bytes = 0;
+}
+
+FrameCache::Statistics FrameCache::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+
+    Statistics statistics;
+    statistics.hits = m_hits;
+    statistics.misses = m_misses;
+    statistics.evictions = m_evictions;
+    statistics.bytes = m_bytes;
+    statistics.budget = m_budget;
+    statistics.frameCount = (int) m_entries.size();
+    statistics.chunkHits = m_chunkHits;
+    statistics.chunkMisses = m_chunkMisses;
+
+    return statistics;
+}
+
+/******************************** Private ***********************************/
+
+FrameCache::Key FrameCache::key(const Dataset *dataset, const Dataset::Slice &slice)
+{
+    std::vector<int64_t> indices(slice.size());
+
+    for(size_t index = 0; index < slice.size(); ++index)
+        indices[index] = slice[index];
+
+    return Key(dataset, indices);
+}
+
+std::vector<int64_t> FrameCache::chunkIndex(const Dataset::Slice &slice,
+                                             const std::vector<int64_t> &shape)
+{
+    std::vector<int64_t> index(slice.size(), 0);
+
+    // The displayed dimensions are read whole, so they don't tell chunks apart
+    for(size_t dimIndex = 0; dimIndex < slice.size() && dimIndex < shape.size(); ++dimIndex)
+    {
+        if(slice[dimIndex] >= 0 && shape[dimIndex] > 0)
+            index[dimIndex] = slice[dimIndex] / shape[dimIndex];
+    }
+
+    return index;
+}
+
+void FrameCache::insert(const Key &key, const std::shared_ptr<Frame> &frame)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(m_entries.find(key) != m_entries.end())
+        return;
+
+    int64_t bytes = frameBytes(frame.get());
+
+    // A frame larger than the whole budget would only flush the cache
+    if(bytes > m_budget)
+        return;
+
+    m_uses.push_front(key);
+
+    Entry &entry = m_entries[key];
+    entry.frame = frame;
+    entry.bytes = bytes;
+    entry.use = m_uses.begin();
+
+    m_bytes += bytes;
+
+    evict();
+}
+
+void FrameCache::evict()
+{
+    while(m_bytes > m_budget && !m_uses.empty())
+    {
+        auto it = m_entries.find(m_uses.back());
+
+        m_bytes -= it->second.bytes;
+        m_entries.erase(it);
+        m_uses.pop_back();
+
+        ++m_evictions;
+    }
+}
+
+} // namespace emd
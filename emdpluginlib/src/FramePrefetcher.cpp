@@ -0,0 +1,200 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "FramePrefetcher.h"
+
+#include <algorithm>
+
+#include "DataGroup.h"
+#include "Dataset.h"
+#include "FrameCache.h"
+#include "Trace.h"
+#include "WorkContext.h"
+#include "WorkScheduler.h"
+
+namespace emd
+{
+
+// Read ahead by about this much time at the current stepping rate
+static const int kLookAheadTime = 1000;     // ms
+// Steps further apart than this start over
+static const int kStepTimeout = 2000;       // ms
+static const int kMinDepth = 4;
+static const int kMaxDepth = 64;
+static const int kMaxFrames = 256;
+
+FramePrefetcher::FramePrefetcher(DataGroup *dataGroup)
+    : m_dataGroup(dataGroup),
+    m_selection(0),
+    m_dimension(-1),
+    m_step(0),
+    m_depth(kMinDepth),
+    m_pending(false)
+{
+    m_name = "Prefetcher";
+
+    connect(this, SIGNAL(workFinished(WorkflowModule *)),
+        this, SLOT(prefetchFinished(WorkflowModule *)), Qt::QueuedConnection);
+}
+
+FramePrefetcher::~FramePrefetcher()
+{
+    // The workers read m_slices and the dataset
+    cancelAndWait();
+}
+
+WorkflowModule::WorkPriority FramePrefetcher::workPriority() const
+{
+    return PriorityBackground;
+}
+
+void FramePrefetcher::doWork(WorkContext *context)
+{
+    EMD_TRACE_ZONE("FramePrefetcher::doWork");
+
+    const Dataset *dataset = m_dataGroup->data();
+
+    FrameCache &cache = FrameCache::instance();
+
+    for(int index = context->start(); index < context->start() + context->count(); ++index)
+    {
+        if(cancelled())
+            break;
+
+        const Dataset::Slice &slice = m_slices[index];
+
+        if(!cache.contains(dataset, slice))
+            cache.frame(dataset, slice, workPriority());
+    }
+}
+
+/******************************** Slots ***********************************/
+
+void FramePrefetcher::updateSelection(const FrameSet::Selection &selection)
+{
+    // Find the single free dimension which moved
+    int dimension = -1;
+    int step = 0;
+    bool moved = (selection.size() == m_selection.size());
+
+    for(int index = 0; moved && index < (int) selection.size(); ++index)
+    {
+        const FrameSet::DimensionInfo &previous = m_selection[index];
+        const FrameSet::DimensionInfo &current = selection[index];
+
+        if(previous.role != current.role || previous.count != current.count)
+            moved = false;
+        else if(previous.start != current.start)
+        {
+            if(dimension >= 0 || FrameSet::isDisplayRole(current.role))
+                moved = false;
+
+            dimension = index;
+            step = (int) current.start - (int) previous.start;
+        }
+    }
+
+    if(dimension < 0)
+        moved = false;
+
+    int interval = kStepTimeout;
+    if(m_stepTimer.isValid())
+        interval = (int) m_stepTimer.restart();
+    else
+        m_stepTimer.start();
+
+    bool continued = moved && dimension == m_dimension && (step > 0) == (m_step > 0)
+        && interval < kStepTimeout;
+
+    m_selection = selection;
+    m_dimension = moved ? dimension : -1;
+    m_step = step;
+
+    if(continued)
+        m_depth = std::min(std::max(kLookAheadTime / std::max(interval, 1), kMinDepth), kMaxDepth);
+    else
+        m_depth = kMinDepth;
+
+    // What is being read is of no use any more
+    if(m_job && !continued)
+        cancel();
+
+    if(!moved)
+    {
+        m_pending = false;
+        return;
+    }
+
+    // Only one job runs at a time, so that m_slices isn't replaced under
+    // the workers' feet. The next plan starts from the latest selection.
+    if(m_job)
+        m_pending = true;
+    else
+        startPrefetch();
+}
+
+void FramePrefetcher::prefetchFinished(WorkflowModule * /*module*/)
+{
+    m_job.reset();
+
+    if(m_pending)
+        startPrefetch();
+}
+
+/******************************** Private ***********************************/
+
+void FramePrefetcher::startPrefetch()
+{
+    m_pending = false;
+
+    if(m_dimension < 0 || FrameCache::instance().budget() == 0)
+        return;
+
+    const FrameSet::DimensionInfo &info = m_selection[m_dimension];
+    int64_t length = m_dataGroup->dimData(m_dimension)->dimLength(0);
+
+    // The slices of the next selections along the dimension, nearest first.
+    // Slices which are cached already are skipped by the workers.
+    FrameSet::Selection ahead = m_selection;
+    m_slices.clear();
+
+    for(int distance = 1; distance <= m_depth && (int) m_slices.size() < kMaxFrames; ++distance)
+    {
+        int64_t start = (int64_t) info.start + (int64_t) distance * m_step;
+
+        if(start < 0 || start + info.count > length)
+            break;
+
+        ahead[m_dimension].start = (unsigned int) start;
+
+        for(int index = 0; index < ahead.count() && (int) m_slices.size() < kMaxFrames; ++index)
+        {
+            m_slices.push_back(ahead.sliceFromIndex(index));
+        }
+    }
+
+    if(m_slices.empty())
+        return;
+
+    m_cancelled.store(false);
+    m_job = WorkScheduler::instance().schedule(this, (int) m_slices.size());
+}
+
+} // namespace emd
@@ -22,6 +22,8 @@
 
 #include "Frame.h"
 
+#include <algorithm>
+
 #include <qdebug.h>
 
 namespace emd
@@ -374,20 +376,94 @@ int FrameSet::Selection::indexFromSlice(const Dataset::Slice &slice) const
     return index;
 }
 
+int FrameSet::Selection::windowDimension(int frameCount, int &steps) const
+{
+    int64_t framesBelow = 1;
+
+    // Dimensions are taken from the least significant, so that each window
+    // is a consecutive range of frame indices.
+    for(int dimIndex = 0; dimIndex < (int)size(); ++dimIndex)
+    {
+        if(isDisplayRole((*this)[dimIndex].role))
+            continue;
+
+        int64_t count = (*this)[dimIndex].count;
+
+        if(framesBelow * count > frameCount)
+        {
+            steps = (int) std::max<int64_t>(1, frameCount / framesBelow);
+            return dimIndex;
+        }
+
+        framesBelow *= count;
+    }
+
+    return -1;
+}
+
+int FrameSet::Selection::windowCount(int frameCount) const
+{
+    int steps = 0;
+    int split = windowDimension(frameCount, steps);
+
+    if(split < 0)
+        return 1;
+
+    int count = ((*this)[split].count + steps - 1) / steps;
+
+    for(int dimIndex = split + 1; dimIndex < (int)size(); ++dimIndex)
+    {
+        if(!isDisplayRole((*this)[dimIndex].role))
+            count *= (*this)[dimIndex].count;
+    }
+
+    return count;
+}
+
+FrameSet::Selection FrameSet::Selection::window(int index, int frameCount) const
+{
+    int steps = 0;
+    int split = windowDimension(frameCount, steps);
+
+    if(split < 0)
+        return *this;
+
+    Selection window(*this);
+
+    int chunks = ((*this)[split].count + steps - 1) / steps;
+    int chunk = index % chunks;
+    index /= chunks;
+
+    window[split].start += chunk * steps;
+    window[split].count = std::min<unsigned int>(steps, (*this)[split].count - chunk * steps);
+
+    // The more significant dimensions are fixed for each window
+    for(int dimIndex = split + 1; dimIndex < (int)size(); ++dimIndex)
+    {
+        if(isDisplayRole((*this)[dimIndex].role))
+            continue;
+
+        window[dimIndex].start += index % (*this)[dimIndex].count;
+        window[dimIndex].count = 1;
+
+        index /= (*this)[dimIndex].count;
+    }
+
+    return window;
+}
+
 // ----------------------------------------------------------------------------------
 
 FrameSet::FrameSet(const Selection &selection)
-    : m_selection(selection)
+    : m_selection(selection),
+    m_windowIndex(0),
+    m_windowCount(1)
 {
-    m_frames.resize(count(), nullptr);
+    m_frames.resize(count());
 }
 
 FrameSet::~FrameSet()
 {
-    for(Frame *frame : m_frames)
-    {
-        delete frame;
-    }
 }
 
 const FrameSet::Selection &FrameSet::selection() const
@@ -415,7 +491,7 @@ Frame *FrameSet::frame(int index) const
     if(index < 0 || index >= m_frames.size())
         return nullptr;
 
-    return m_frames[index];
+    return m_frames[index].get();
 }
 
 Frame *FrameSet::frame(Dataset::Slice slice) const
@@ -423,6 +499,14 @@ Frame *FrameSet::frame(Dataset::Slice slice) const
     return frame(m_selection.indexFromSlice(slice));
 }
 
+std::shared_ptr<Frame> FrameSet::sharedFrame(int index) const
+{
+    if(index < 0 || index >= m_frames.size())
+        return std::shared_ptr<Frame>();
+
+    return m_frames[index];
+}
+
 void FrameSet::setFrame(Frame *frame, int index)
 {
     if(index < 0 || index >= m_frames.size())
@@ -430,7 +514,7 @@ void FrameSet::setFrame(Frame *frame, int index)
         return;
     }
 
-    m_frames[index] = frame;
+    m_frames[index].reset(frame);
 }
 
 void FrameSet::setFrame(Frame *frame, const Dataset::Slice &slice)
@@ -438,6 +522,16 @@ void FrameSet::setFrame(Frame *frame, const Dataset::Slice &slice)
     setFrame(frame, m_selection.indexFromSlice(slice));
 }
 
+void FrameSet::setSharedFrame(const std::shared_ptr<Frame> &frame, int index)
+{
+    if(index < 0 || index >= m_frames.size())
+    {
+        return;
+    }
+
+    m_frames[index] = frame;
+}
+
 FrameSet::Selection::SelectionIterator FrameSet::beginSelection() const
 {
     return m_selection.beginSelection();
@@ -477,11 +571,41 @@ void FrameSet::subtract(const FrameSet &other, emd::FrameList &result) const
     }
 }
 
+void FrameSet::subtract(const FrameSet &other, std::vector<std::shared_ptr<Frame>> &result) const
+{
+    Selection::SliceIterator it = this->beginSlice();
+    Selection::SliceIterator end = this->endSlice();
+
+    while(it != end)
+    {
+        if(!other.containsSlice(*it))
+            result.push_back(this->sharedFrame(sliceIndex(*it)));
+
+        ++it;
+    }
+}
+
 int FrameSet::sliceIndex(const Dataset::Slice &slice) const
 {
     return m_selection.indexFromSlice(slice);
 }
 
+int FrameSet::windowIndex() const
+{
+    return m_windowIndex;
+}
+
+int FrameSet::windowCount() const
+{
+    return m_windowCount;
+}
+
+void FrameSet::setWindow(int index, int count)
+{
+    m_windowIndex = index;
+    m_windowCount = count;
+}
+
 // -------------------------------------------------------------------------------
 
 } // namespace emd
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "HistogramModule.h"
 
 #include "ColourManager.h"
+#include "DataTypeDispatch.h"
 #include "Frame.h"
 #include "Histogram.h"
 
@@ -88,6 +89,19 @@ bool HistogramModule::validate() const
     return true;
 }
 
+WorkflowModule::ConcurrencyMode HistogramModule::concurrencyMode() const
+{
+    // Each frame emits its own histogram image, so frames must be processed
+    // in order.
+    return ConcurrencySerial;
+}
+
+WorkflowModule::WorkPriority HistogramModule::workPriority() const
+{
+    // The histogram can trail the image by a frame or two.
+    return PriorityAuxiliary;
+}
+
 void HistogramModule::reset(const DataGroup *dataGroup)
 {
     m_histogram->reset(dataGroup);
@@ -104,33 +118,7 @@ void HistogramModule::preprocess()
 
 Frame *HistogramModule::processFrame(Frame *frame, int /*index*/)
 {
-	switch(frame->dataType())
-	{
-	case DataTypeInt8:
-		return processData<int8_t>(frame);
-	case DataTypeInt16:
-		return processData<int16_t>(frame);
-	case DataTypeInt32:
-		return processData<int32_t>(frame);
-	case DataTypeInt64:
-		return processData<int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<float>(frame);
-	case DataTypeFloat64:
-		return processData<double>(frame);
-	default:
-		break;
-	}
-
-    return NULL;
+	return dispatchDataType<ProcessDataKernel>(frame->dataType(), this, frame);
 }
 
 void HistogramModule::postprocess()
@@ -253,7 +241,7 @@ Frame *HistogramModule::processData(Frame *frame)
 		emit(histogramGenerated(histogram, dataMin, dataMax));
 	}
 
-    return new Frame(frame->data<void>(), frame->dataType(), false);
+    return frame;
 }
 
 /************************************* Slots ***********************************/
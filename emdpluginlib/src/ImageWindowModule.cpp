@@ -30,7 +30,10 @@
 
 #include "ColourManager.h"
 #include "ColourMapSelector.h"
+#include "DataTypeDispatch.h"
 #include "Frame.h"
+#include "PixelKernels.h"
+#include "Trace.h"
 
 namespace emd
 {
@@ -113,6 +116,22 @@ void ImageWindowModule::doPropertyChanged(const QString &key)
     }
 }
 
+WorkflowModule::ConcurrencyMode ImageWindowModule::concurrencyMode() const
+{
+    // The colour scaling limits and the generated image list are shared
+    // between frames.
+    return ConcurrencySerial;
+}
+
+WorkflowModule::FrameLayout ImageWindowModule::inputLayout() const
+{
+    // Scan lines run along x, which is the vertical axis of flipped data
+    if(m_inputContext.axesFlipped())
+        return LayoutColumnMajor;
+
+    return LayoutRowMajor;
+}
+
 void ImageWindowModule::preprocess()
 {
     
@@ -120,6 +139,8 @@ void ImageWindowModule::preprocess()
 
 void ImageWindowModule::postprocess()
 {
+    EMD_TRACE_ZONE("ImageWindowModule::postprocess");
+
     for(int index = 0; index < m_images.size(); ++index)
     {
         emit(imageGenerated(m_images.at(index)));
@@ -128,35 +149,19 @@ void ImageWindowModule::postprocess()
     m_images.clear();
 }
 
-Frame *ImageWindowModule::processFrame(Frame *frame, int /*index*/)
+void ImageWindowModule::discardResults()
 {
-	switch(frame->dataType())
-	{
-	case DataTypeInt8:
-		return processData<int8_t>(frame);
-	case DataTypeInt16:
-		return processData<int16_t>(frame);
-	case DataTypeInt32:
-		return processData<int32_t>(frame);
-	case DataTypeInt64:
-		return processData<int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<float>(frame);
-	case DataTypeFloat64:
-		return processData<double>(frame);
-	default:
-		break;
-	}
+    for(int index = 0; index < m_images.size(); ++index)
+    {
+        delete m_images.at(index);
+    }
 
-    return NULL;
+    m_images.clear();
+}
+
+Frame *ImageWindowModule::processFrame(Frame *frame, int /*index*/)
+{
+	return dispatchDataType<ProcessDataKernel>(frame->dataType(), this, frame);
 }
 
 // Private
@@ -166,7 +171,7 @@ Frame *ImageWindowModule::processData(Frame *frame)
 {
 	T min, max;
 
-	frame->getDataRange(min, max);
+	getDataRange(frame, min, max);
 
 	m_lowerScalingLimit = (float) min;
 	m_upperScalingLimit = (float) max;
@@ -211,63 +216,56 @@ Frame *ImageWindowModule::processData(Frame *frame)
 		ySize = data.hSize;
 	}
     
-	QImage *image = new QImage(xSize, ySize, QImage::Format_RGB32);
+	QImage *image = createImage(xSize, ySize, QImage::Format_RGB32);
 
     ColourMap map = ColourManager::instance().colourMap(property("ColourMap").toString());
 	const QRgb *colourTable = map.colourTable();
 	int colourRange = map.colourTableRange() - 1;
 
-	int kkk = 0;
-	int offset = 0;
-	// If we have a non-zero image, fill in the pixels normally
-	if(range > kSmallFloat)
-	{
-		float rangeMult = (float) colourRange / range;
-		int val;
+	// Write the pixels directly; setPixel() isn't safe to call from several
+	// threads on the same image.
+	QRgb *pixels = (QRgb *) image->bits();
+	int pixelStride = image->bytesPerLine() / sizeof(QRgb);
 
-		for(int iii = 0; iii < xSize; ++iii)
+	// Each tile fills a range of scan lines. The input is laid out with x
+	// at unit stride (see inputLayout()), like the pixels.
+	processTiles(ySize, xSize, [&](int begin, int end)
+	{
+		// If we have a non-zero image, fill in the pixels normally
+		if(range > kSmallFloat)
 		{
-			for(int jjj = 0; jjj < ySize; ++jjj)
-			{
-				val = (int) (rangeMult * (data.real[kkk] - min));
-
-				if(val > colourRange)
-					val = colourRange;
-				else if(val < 0)
-					val = 0;
+			float rangeMult = (float) colourRange / range;
 
-				image->setPixel(iii, jjj, colourTable[val]);
-				kkk += yStep;
+			for(int jjj = begin; jjj < end; ++jjj)
+			{
+				ColourMapKernel<T>::run(data.real + jjj * yStep, pixels + jjj * pixelStride,
+				                        xSize, min, rangeMult, colourTable, colourRange);
 			}
-			offset += xStep;
-			kkk = offset;
 		}
-	}
-	// If the range is effectively zero, gate the pixels
-	else
-	{
-		uint minColour = colourTable[0];
-		uint maxColour = colourTable[colourRange];
-		uint colour;
-		for(int iii = 0; iii < xSize; ++iii)
+		// If the range is effectively zero, gate the pixels
+		else
 		{
-			for(int jjj = 0; jjj < ySize; ++jjj)
+			uint minColour = colourTable[0];
+			uint maxColour = colourTable[colourRange];
+			for(int jjj = begin; jjj < end; ++jjj)
 			{
-				if(data.real[kkk] < min)
-					colour = minColour;
-				else
-					colour = maxColour;
-				image->setPixel(iii, jjj, colour);
-				kkk += yStep;
+				const T *line = data.real + jjj * yStep;
+				QRgb *pixelLine = pixels + jjj * pixelStride;
+
+				for(int iii = 0; iii < xSize; ++iii)
+				{
+					if(line[iii * xStep] < min)
+						pixelLine[iii] = minColour;
+					else
+						pixelLine[iii] = maxColour;
+				}
 			}
-			offset += xStep;
-			kkk = offset;
 		}
-	}
+	});
 
     m_images.push_back(image);
 
-    return new Frame(frame);
+    return frame;
 }
 
 } // namespace emd
@@ -0,0 +1,190 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "MappedFrameReader.h"
+
+#include <limits>
+
+#include <QDebug>
+#include <QFile>
+#include <QMutexLocker>
+
+#include "Util.h"
+
+namespace emd
+{
+
+struct MappedFrameReader::Mapping
+{
+    QFile file;
+    uchar *data;
+    std::vector<int64_t> dimensions;
+    // In elements
+    std::vector<int64_t> strides;
+    DataType type;
+    int elementBytes;
+    int complexDimension;
+
+    Mapping()
+        : data(nullptr)
+    {}
+
+    ~Mapping()
+    {
+        if(data)
+            file.unmap(data);
+    }
+};
+
+MappedFrameReader &MappedFrameReader::instance()
+{
+    static MappedFrameReader reader;
+
+    return reader;
+}
+
+MappedFrameReader::MappedFrameReader()
+{
+}
+
+bool MappedFrameReader::addDataset(const Dataset *dataset, const QString &filePath, int64_t offset,
+                                   const std::vector<int64_t> &dimensions, DataType type,
+                                   int complexDimension)
+{
+    std::shared_ptr<Mapping> mapping = std::make_shared<Mapping>();
+    mapping->dimensions = dimensions;
+    mapping->type = type;
+    mapping->elementBytes = emdTypeDepth(type);
+    mapping->complexDimension = complexDimension;
+
+    if(complexDimension >= (int) dimensions.size()
+       || (complexDimension >= 0 && dimensions[complexDimension] != 2))
+        return false;
+
+    // C order: the last dimension is contiguous
+    mapping->strides.resize(dimensions.size());
+
+    int64_t count = 1;
+    for(int index = (int) dimensions.size() - 1; index >= 0; --index)
+    {
+        mapping->strides[index] = count;
+        count *= dimensions[index];
+    }
+
+    int64_t bytes = count * mapping->elementBytes;
+
+    mapping->file.setFileName(filePath);
+
+    if(!mapping->file.open(QIODevice::ReadOnly))
+        return false;
+
+    if(offset < 0 || bytes <= 0 || offset + bytes > mapping->file.size())
+        return false;
+
+    mapping->data = mapping->file.map(offset, bytes);
+
+    if(!mapping->data)
+    {
+        qWarning() << "Failed to map" << filePath << ":" << mapping->file.errorString();
+        return false;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_mappings[dataset] = mapping;
+
+    return true;
+}
+
+void MappedFrameReader::removeDataset(const Dataset *dataset)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_mappings.erase(dataset);
+}
+
+bool MappedFrameReader::contains(const Dataset *dataset) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    return m_mappings.find(dataset) != m_mappings.end();
+}
+
+std::shared_ptr<Frame> MappedFrameReader::frame(const Dataset *dataset,
+                                                const Dataset::Slice &slice) const
+{
+    std::shared_ptr<Mapping> mapping;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        auto it = m_mappings.find(dataset);
+        if(it == m_mappings.end())
+            return std::shared_ptr<Frame>();
+
+        mapping = it->second;
+    }
+
+    if(slice.size() != mapping->dimensions.size())
+        return std::shared_ptr<Frame>();
+
+    int hDimension = -1;
+    int vDimension = -1;
+    int64_t offset = 0;
+
+    for(int index = 0; index < (int) slice.size(); ++index)
+    {
+        if(slice[index] == Dataset::HorizontalDimension)
+            hDimension = index;
+        else if(slice[index] == Dataset::VerticalDimension)
+            vDimension = index;
+        else if(index == mapping->complexDimension)
+            continue;
+        else if(slice[index] < 0 || slice[index] >= mapping->dimensions[index])
+            return std::shared_ptr<Frame>();
+        else
+            offset += slice[index] * mapping->strides[index];
+    }
+
+    if(hDimension < 0 || vDimension < 0)
+        return std::shared_ptr<Frame>();
+
+    // Frame strides and sizes are ints
+    const int64_t limit = std::numeric_limits<int>::max();
+    if(mapping->strides[hDimension] > limit || mapping->strides[vDimension] > limit
+       || mapping->dimensions[hDimension] > limit || mapping->dimensions[vDimension] > limit)
+        return std::shared_ptr<Frame>();
+
+    uchar *real = mapping->data + offset * mapping->elementBytes;
+    uchar *imaginary = nullptr;
+
+    if(mapping->complexDimension >= 0)
+        imaginary = real + mapping->strides[mapping->complexDimension] * mapping->elementBytes;
+
+    Frame::Data<void> data(imaginary ? Frame::AttributeComplex : 0,
+        (int) mapping->strides[hDimension], (int) mapping->strides[vDimension],
+        (int) mapping->dimensions[hDimension], (int) mapping->dimensions[vDimension],
+        real, imaginary);
+
+    // The frame doesn't own the data; the deleter keeps the mapping alive
+    // for as long as the frame is.
+    return std::shared_ptr<Frame>(new Frame(data, mapping->type, false),
+        [mapping](Frame *frame) { delete frame; });
+}
+
+} // namespace emd
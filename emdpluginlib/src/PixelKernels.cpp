@@ -0,0 +1,130 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "PixelKernels.h"
+
+#include <string.h>
+
+#include "EmdKernels.h"
+
+namespace emd
+{
+
+using kernels::kernelTable;
+
+/******************************** ConvertKernel **********************************/
+
+void ConvertKernel<uint16_t>::run(const uint16_t *input, float *output, int count)
+{
+    kernelTable().convertU16(input, output, count);
+}
+
+void ConvertKernel<float>::run(const float *input, float *output, int count)
+{
+    if(count > 0)
+        memcpy(output, input, (size_t) count * sizeof(float));
+}
+
+/******************************** ComplexKernel **********************************/
+
+void ComplexKernel<float>::amplitude(const float *real, const float *imaginary,
+                                     float *output, int count)
+{
+    kernelTable().amplitudeF32(real, imaginary, output, count);
+}
+
+void ComplexKernel<float>::intensity(const float *real, const float *imaginary,
+                                     float *output, int count)
+{
+    kernelTable().intensityF32(real, imaginary, output, count);
+}
+
+void ComplexKernel<float>::phase(const float *real, const float *imaginary,
+                                 float *output, int count)
+{
+    kernelTable().phaseF32(real, imaginary, output, count);
+}
+
+/********************************* RangeKernel ***********************************/
+
+void RangeKernel<uint16_t>::run(const uint16_t *input, int count, uint16_t &min, uint16_t &max)
+{
+    kernelTable().rangeU16(input, count, min, max);
+}
+
+void RangeKernel<float>::run(const float *input, int count, float &min, float &max)
+{
+    kernelTable().rangeF32(input, count, min, max);
+}
+
+/********************************* ScaleKernel ***********************************/
+
+void ScaleKernel<uint16_t>::run(const uint16_t *input, float *output, int count,
+                                uint16_t inputOffset, float factor, float outputOffset,
+                                float lower, float upper)
+{
+    kernelTable().scaleU16(input, output, count, (float) inputOffset, factor, outputOffset,
+                           lower, upper);
+}
+
+void ScaleKernel<float>::run(const float *input, float *output, int count,
+                             float inputOffset, float factor, float outputOffset,
+                             float lower, float upper)
+{
+    kernelTable().scaleF32(input, output, count, inputOffset, factor, outputOffset,
+                           lower, upper);
+}
+
+/******************************* ColourMapKernel *********************************/
+
+void ColourMapKernel<uint16_t>::run(const uint16_t *input, uint32_t *output, int count,
+                                    uint16_t offset, float factor, const uint32_t *table,
+                                    int tableMax)
+{
+    kernelTable().colourMapU16(input, output, count, (float) offset, factor, table, tableMax);
+}
+
+void ColourMapKernel<float>::run(const float *input, uint32_t *output, int count,
+                                 float offset, float factor, const uint32_t *table,
+                                 int tableMax)
+{
+    kernelTable().colourMapF32(input, output, count, offset, factor, table, tableMax);
+}
+
+/******************************* AccumulateKernel ********************************/
+
+void AccumulateKernel<uint16_t>::run(const uint16_t *input, float *result, int count,
+                                     double keep, double weight)
+{
+    kernelTable().accumulateU16(input, result, count, (float) keep, (float) weight);
+}
+
+void AccumulateKernel<float>::run(const float *input, float *result, int count,
+                                  double keep, double weight)
+{
+    kernelTable().accumulateF32(input, result, count, (float) keep, (float) weight);
+}
+
+const char *pixelKernelInstructionSet()
+{
+    return kernels::instructionSetName(kernelTable().instructionSet);
+}
+
+} // namespace emd
@@ -112,4 +112,22 @@ void ProcessingContext::setFrameAtIndex(Frame *frame, int index)
     }
 }
 
+std::shared_ptr<Frame> ProcessingContext::sharedFrameAtIndex(int index) const
+{
+    if(m_impl.get())
+    {
+        return m_impl->frameSet()->sharedFrame(index);
+    }
+
+    return std::shared_ptr<Frame>();
+}
+
+void ProcessingContext::setSharedFrameAtIndex(const std::shared_ptr<Frame> &frame, int index)
+{
+    if(m_impl.get())
+    {
+        m_impl->frameSet()->setSharedFrame(frame, index);
+    }
+}
+
 }
\ No newline at end of file
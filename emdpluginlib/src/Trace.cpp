@@ -0,0 +1,213 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <QThread>
+
+namespace emd
+{
+
+namespace
+{
+
+// Per-thread capacity; 16k zones covers several seconds of interactive use.
+const uint64_t kBufferSize = 1 << 14;
+
+struct TraceEvent
+{
+    const char *name;
+    int64_t begin;
+    int64_t end;
+};
+
+// Single writer (the owning thread), any number of readers. The head only
+// ever grows; a reader re-checks it after copying to drop the events which
+// were overwritten in the meantime.
+struct TraceBuffer
+{
+    TraceBuffer(int id, const QString &name)
+        : id(id),
+        threadName(name),
+        head(0),
+        events(kBufferSize)
+    {
+    }
+
+    int id;
+    QString threadName;
+    std::atomic<uint64_t> head;
+    std::vector<TraceEvent> events;
+};
+
+// Buffers outlive their threads so that finished workers still show up in
+// the dump. The mutex is only taken when a thread records its first zone and
+// when saving.
+QMutex s_buffersMutex;
+std::vector<TraceBuffer*> s_buffers;
+
+TraceBuffer *threadBuffer()
+{
+    static thread_local TraceBuffer *buffer = NULL;
+
+    if(!buffer)
+    {
+        QMutexLocker locker(&s_buffersMutex);
+
+        QThread *thread = QThread::currentThread();
+        QString name = thread->objectName();
+        if(name.isEmpty())
+        {
+            if(QCoreApplication::instance()
+                && thread == QCoreApplication::instance()->thread())
+                name = "Main";
+            else
+                name = QString("Thread %1").arg(s_buffers.size());
+        }
+
+        buffer = new TraceBuffer((int)s_buffers.size() + 1, name);
+        s_buffers.push_back(buffer);
+    }
+
+    return buffer;
+}
+
+QString escaped(const QString &string)
+{
+    QString result = string;
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+    return result;
+}
+
+} // namespace
+
+bool Trace::enabled()
+{
+#ifdef EMD_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+int64_t Trace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char *name, int64_t begin, int64_t end)
+{
+    TraceBuffer *buffer = threadBuffer();
+
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+
+    TraceEvent &event = buffer->events[head % kBufferSize];
+    event.name = name;
+    event.begin = begin;
+    event.end = end;
+
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Trace::save(const QString &path)
+{
+    QFile file(path);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        return false;
+
+    QTextStream stream(&file);
+    stream << "{\"traceEvents\":[";
+
+    bool first = true;
+    int64_t origin = -1;
+
+    QMutexLocker locker(&s_buffersMutex);
+
+    // Copy everything out first so that the timestamps can be made relative
+    // to the earliest event.
+    std::vector<std::vector<TraceEvent>> snapshots;
+    for(TraceBuffer *buffer : s_buffers)
+    {
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t tail = head > kBufferSize ? head - kBufferSize : 0;
+
+        std::vector<TraceEvent> events;
+        events.reserve(head - tail);
+        for(uint64_t index = tail; index < head; ++index)
+            events.push_back(buffer->events[index % kBufferSize]);
+
+        // Drop the events the owner may have overwritten while copying
+        uint64_t newHead = buffer->head.load(std::memory_order_acquire);
+        if(newHead > kBufferSize && newHead - kBufferSize > tail)
+        {
+            uint64_t overwritten = std::min<uint64_t>(
+                newHead - kBufferSize - tail, events.size());
+            events.erase(events.begin(), events.begin() + overwritten);
+        }
+
+        for(const TraceEvent &event : events)
+        {
+            if(origin < 0 || event.begin < origin)
+                origin = event.begin;
+        }
+
+        snapshots.push_back(std::move(events));
+    }
+
+    for(size_t index = 0; index < s_buffers.size(); ++index)
+    {
+        const TraceBuffer *buffer = s_buffers[index];
+
+        stream << (first ? "\n" : ",\n");
+        first = false;
+        stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << buffer->id << ",\"args\":{\"name\":\""
+            << escaped(buffer->threadName) << "\"}}";
+
+        for(const TraceEvent &event : snapshots[index])
+        {
+            // Chrome trace timestamps are in microseconds
+            stream << ",\n{\"name\":\"" << escaped(QString(event.name))
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id
+                << ",\"ts\":" << QString::number((event.begin - origin) / 1000.0, 'f', 3)
+                << ",\"dur\":" << QString::number((event.end - event.begin) / 1000.0, 'f', 3)
+                << "}";
+        }
+    }
+
+    stream << "\n]}\n";
+    stream.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+} // namespace emd
@@ -20,19 +20,50 @@
 
 #include "WorkContext.h"
 
+#include <limits>
+#include <utility>
+
 #include "WorkflowModule.h"
 
 namespace emd
 {
 
-WorkContext::WorkContext(WorkflowModule *module)
-    : m_module(module)
+// Target duration of a single chunk, in nanoseconds.
+static const int64_t kTargetChunkTime = 2000000;
+
+static const int kMaxChunkSize = 1024;
+
+/******************************** WorkContext *********************************/
+
+WorkContext::WorkContext()
+    : m_start(0),
+    m_count(0)
+{
+}
+
+WorkContext::WorkContext(const std::shared_ptr<WorkJob> &job, int start, int count)
+    : m_job(job),
+    m_start(start),
+    m_count(count)
+{
+}
+
+bool WorkContext::isValid() const
 {
+    return (m_job.get() != nullptr);
 }
 
 WorkflowModule *WorkContext::module() const
 {
-    return m_module;
+    if(m_job.get())
+        return m_job->module();
+
+    return nullptr;
+}
+
+const std::shared_ptr<WorkJob> &WorkContext::job() const
+{
+    return m_job;
 }
 
 int WorkContext::start() const
@@ -55,4 +86,254 @@ void WorkContext::setCount(int count)
     m_count = count;
 }
 
+/********************************** WorkJob ***********************************/
+
+WorkJob::WorkJob(WorkflowModule *module, int frameCount, bool serial, bool streaming)
+    : m_module(module),
+    m_frameCount(frameCount),
+    m_serial(serial),
+    m_streaming(streaming),
+    m_priority(module->workPriority()),
+    m_remainingFrames(frameCount),
+    m_frameCost(0),
+    m_workTime(0),
+    m_available(serial ? frameCount : 0, streaming ? 0 : 1),
+    m_nextFrame(0),
+    m_running(false),
+    m_finished(frameCount, 0),
+    m_frontier(0),
+    m_window(0),
+    m_done(false)
+{
+}
+
+WorkflowModule *WorkJob::module() const
+{
+    return m_module;
+}
+
+int WorkJob::frameCount() const
+{
+    return m_frameCount;
+}
+
+bool WorkJob::serial() const
+{
+    return m_serial;
+}
+
+int WorkJob::priority() const
+{
+    return m_priority;
+}
+
+int WorkJob::chunkSize() const
+{
+    int64_t cost = m_frameCost.load();
+
+    // Until the first chunk has been timed, hand out single frames.
+    if(cost <= 0)
+        return 1;
+
+    int64_t size = kTargetChunkTime / cost;
+
+    if(size < 1)
+        return 1;
+    if(size > kMaxChunkSize)
+        return kMaxChunkSize;
+
+    return (int) size;
+}
+
+int64_t WorkJob::workTime() const
+{
+    return m_workTime.load();
+}
+
+void WorkJob::start(int threadCount, std::vector<WorkContext> &runnable)
+{
+    if(m_streaming || m_frameCount == 0)
+        return;
+
+    if(m_serial)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        nextSerialRun(runnable);
+        return;
+    }
+
+    // Give each worker one contiguous range. Workers split their range into
+    // chunks as they go, and steal when they run dry.
+    int parts = threadCount < m_frameCount ? threadCount : m_frameCount;
+    int start = 0;
+
+    for(int part = 0; part < parts; ++part)
+    {
+        int count = m_frameCount / parts + (part < m_frameCount % parts ? 1 : 0);
+
+        runnable.push_back(WorkContext(shared_from_this(), start, count));
+
+        start += count;
+    }
+}
+
+void WorkJob::addConsumer(const std::shared_ptr<WorkJob> &consumer, int window,
+                          std::vector<WorkContext> &runnable)
+{
+    std::vector<std::pair<int, int>> ranges;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        m_consumers.push_back(consumer);
+        m_window = window;
+
+        int index = 0;
+        while(index < m_frameCount)
+        {
+            if(!m_finished[index])
+            {
+                ++index;
+                continue;
+            }
+
+            int start = index;
+            while(index < m_frameCount && m_finished[index])
+                ++index;
+
+            ranges.push_back(std::make_pair(start, index - start));
+        }
+    }
+
+    for(const std::pair<int, int> &range : ranges)
+        consumer->releaseFrames(range.first, range.second, runnable);
+}
+
+bool WorkJob::throttled(int start) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    int limit = std::numeric_limits<int>::max();
+
+    for(const std::shared_ptr<WorkJob> &consumer : m_consumers)
+    {
+        int consumerLimit = consumer->m_frontier.load() + m_window;
+        if(consumerLimit < limit)
+            limit = consumerLimit;
+    }
+
+    return (start >= limit);
+}
+
+bool WorkJob::frameFinished(int index) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    if(index < 0 || index >= m_frameCount)
+        return false;
+
+    return (m_finished[index] != 0);
+}
+
+bool WorkJob::finishFrames(int start, int count, int64_t nsecs,
+                           std::vector<WorkContext> &runnable)
+{
+    m_workTime.fetch_add(nsecs);
+
+    if(count > 0)
+    {
+        // Exponential moving average of the per-frame cost. Concurrent
+        // updates may overwrite each other, which only loses a sample.
+        int64_t sample = nsecs / count;
+        int64_t cost = m_frameCost.load();
+
+        if(cost <= 0)
+            m_frameCost.store(sample);
+        else
+            m_frameCost.store((3 * cost + sample) / 4);
+    }
+
+    std::vector<std::shared_ptr<WorkJob>> consumers;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for(int index = start; index < start + count; ++index)
+            m_finished[index] = 1;
+
+        int frontier = m_frontier.load();
+        while(frontier < m_frameCount && m_finished[frontier])
+            ++frontier;
+        m_frontier.store(frontier);
+
+        if(m_serial)
+        {
+            m_running = false;
+            nextSerialRun(runnable);
+        }
+
+        consumers = m_consumers;
+    }
+
+    // Consumers must see the frames before the job is reported as finished
+    for(const std::shared_ptr<WorkJob> &consumer : consumers)
+        consumer->releaseFrames(start, count, runnable);
+
+    return (m_remainingFrames.fetch_sub(count) == count);
+}
+
+void WorkJob::setDone()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_done = true;
+    m_doneCondition.wakeAll();
+}
+
+void WorkJob::wait()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while(!m_done)
+        m_doneCondition.wait(&m_mutex);
+}
+
+void WorkJob::releaseFrames(int start, int count, std::vector<WorkContext> &runnable)
+{
+    if(!m_serial)
+    {
+        runnable.push_back(WorkContext(shared_from_this(), start, count));
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    for(int index = start; index < start + count; ++index)
+        m_available[index] = 1;
+
+    nextSerialRun(runnable);
+}
+
+// Called with m_mutex held.
+void WorkJob::nextSerialRun(std::vector<WorkContext> &runnable)
+{
+    if(m_running || m_nextFrame >= m_frameCount || !m_available[m_nextFrame])
+        return;
+
+    int limit = chunkSize();
+    int count = 0;
+
+    while(count < limit && m_nextFrame + count < m_frameCount
+          && m_available[m_nextFrame + count])
+    {
+        ++count;
+    }
+
+    runnable.push_back(WorkContext(shared_from_this(), m_nextFrame, count));
+
+    m_nextFrame += count;
+    m_running = true;
+}
+
 }
\ No newline at end of file
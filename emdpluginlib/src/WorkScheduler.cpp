@@ -0,0 +1,426 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "WorkScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
+
+#include <QSettings>
+
+#include "WorkContext.h"
+#include "WorkerThread.h"
+#include "WorkflowModule.h"
+
+namespace emd
+{
+
+// A producer may run this many frames per worker thread ahead of its
+// slowest streaming consumer.
+static const int kStreamFramesPerThread = 4;
+
+class TileTask
+{
+public:
+    TileTask(int priority, const std::function<void(int)> *function, int tileCount)
+        : priority(priority),
+        function(function),
+        tileCount(tileCount),
+        nextTile(0),
+        finishedTiles(0)
+    {
+    }
+
+    int priority;
+    const std::function<void(int)> *function;
+    int tileCount;
+    std::atomic<int> nextTile;
+    std::atomic<int> finishedTiles;
+
+    QMutex mutex;
+    QWaitCondition condition;
+};
+
+/******************************** Static Methods ********************************/
+
+WorkScheduler &WorkScheduler::instance()
+{
+    static WorkScheduler scheduler;
+
+    return scheduler;
+}
+
+int WorkScheduler::idealThreadCount()
+{
+    int count = (int) std::thread::hardware_concurrency();
+
+    // hardware_concurrency() returns 0 if the value is not computable.
+    if(count <= 0)
+        count = 1;
+
+    return count;
+}
+
+int WorkScheduler::environmentThreadCount()
+{
+    bool ok = false;
+    int count = qgetenv("EMD_WORKER_THREADS").toInt(&ok);
+
+    if(!ok || count < 0)
+        return 0;
+
+    return count;
+}
+
+void WorkScheduler::runTileTask(TileTask &task)
+{
+    int tile;
+
+    while((tile = task.nextTile.fetch_add(1)) < task.tileCount)
+    {
+        (*task.function)(tile);
+
+        if(task.finishedTiles.fetch_add(1) + 1 == task.tileCount)
+        {
+            QMutexLocker locker(&task.mutex);
+            task.condition.wakeAll();
+        }
+    }
+}
+
+/******************************** Instance Methods *******************************/
+
+WorkScheduler::WorkScheduler()
+    : m_initialized(false),
+    m_nextThread(0),
+    m_version(0),
+    m_throttled(false)
+{
+}
+
+WorkScheduler::~WorkScheduler()
+{
+    m_mutex.lock();
+    for(WorkerThread *thread : m_threads)
+        thread->requestShutdown();
+    m_condition.wakeAll();
+    m_mutex.unlock();
+
+    for(WorkerThread *thread : m_threads)
+        delete thread;
+}
+
+void WorkScheduler::initialize()
+{
+    if(!m_initialized)
+    {
+        m_initialized = true;
+
+        int count = environmentThreadCount();
+
+        if(count <= 0)
+        {
+            QSettings settings;
+            count = settings.value("Preferences/WorkerThreadCount", 0).toInt();
+        }
+
+        setThreadCount(count);
+    }
+}
+
+int WorkScheduler::threadCount()
+{
+    initialize();
+
+    QReadLocker locker(&m_threadLock);
+
+    return (int) m_threads.size();
+}
+
+void WorkScheduler::setThreadCount(int count)
+{
+    m_initialized = true;
+
+    if(count <= 0)
+        count = idealThreadCount();
+
+    std::vector<WorkerThread*> retired;
+
+    {
+        QWriteLocker locker(&m_threadLock);
+
+        while((int) m_threads.size() < count)
+        {
+            WorkerThread *thread = new WorkerThread(this, (int) m_threads.size());
+            m_threads.push_back(thread);
+            thread->start(QThread::LowPriority);
+        }
+
+        while((int) m_threads.size() > count)
+        {
+            retired.push_back(m_threads.back());
+            m_threads.pop_back();
+        }
+
+        m_nextThread.store(0);
+    }
+
+    if(retired.empty())
+        return;
+
+    m_mutex.lock();
+    for(WorkerThread *thread : retired)
+        thread->requestShutdown();
+    m_condition.wakeAll();
+    m_mutex.unlock();
+
+    // Retired threads finish their current range; anything left in their
+    // queues is handed to the remaining threads.
+    std::deque<WorkContext> work;
+
+    for(WorkerThread *thread : retired)
+    {
+        thread->wait();
+        thread->takeAllWork(work);
+        delete thread;
+    }
+
+    queueWork(std::vector<WorkContext>(work.begin(), work.end()));
+}
+
+std::shared_ptr<WorkJob> WorkScheduler::schedule(WorkflowModule *module, int frameCount,
+                                                 const std::shared_ptr<WorkJob> &producer)
+{
+    initialize();
+
+    bool serial = (module->concurrencyMode() == WorkflowModule::ConcurrencySerial
+                   || frameCount == 1);
+    bool streaming = (producer.get() != nullptr);
+
+    std::shared_ptr<WorkJob> job = std::make_shared<WorkJob>(module, frameCount,
+                                                             serial, streaming);
+
+    std::vector<WorkContext> work;
+
+    if(streaming)
+        producer->addConsumer(job, kStreamFramesPerThread * threadCount(), work);
+    else
+        job->start(threadCount(), work);
+
+    queueWork(work);
+
+    return job;
+}
+
+void WorkScheduler::runTiles(int priority, int tileCount,
+                             const std::function<void(int)> &function)
+{
+    if(tileCount <= 1)
+    {
+        if(tileCount == 1)
+            function(0);
+        return;
+    }
+
+    std::shared_ptr<TileTask> task = std::make_shared<TileTask>(priority, &function, tileCount);
+
+    m_mutex.lock();
+    m_tileTasks.push_back(task);
+    ++m_version;
+    m_condition.wakeAll();
+    m_mutex.unlock();
+
+    runTileTask(*task);
+
+    // Every tile has been claimed, so no other worker needs to find the task
+    m_mutex.lock();
+    m_tileTasks.erase(std::remove(m_tileTasks.begin(), m_tileTasks.end(), task),
+                      m_tileTasks.end());
+    m_mutex.unlock();
+
+    QMutexLocker locker(&task->mutex);
+    while(task->finishedTiles.load() < tileCount)
+        task->condition.wait(&task->mutex);
+}
+
+bool WorkScheduler::takeWork(WorkerThread *thread, WorkContext &context)
+{
+    forever
+    {
+        uint64_t version;
+        std::shared_ptr<TileTask> task;
+
+        m_mutex.lock();
+        if(thread->shuttingDown())
+        {
+            m_mutex.unlock();
+            return false;
+        }
+        version = m_version;
+        for(const std::shared_ptr<TileTask> &pending : m_tileTasks)
+        {
+            if(pending->nextTile.load() < pending->tileCount
+               && (!task || pending->priority < task->priority))
+            {
+                task = pending;
+            }
+        }
+        m_mutex.unlock();
+
+        bool throttled = false;
+
+        // Tiles hold up a worker waiting for its frame, so they come before
+        // any frames except those of a more urgent class.
+        if(task)
+        {
+            if(findWork(thread, context, throttled, task->priority))
+                return true;
+
+            runTileTask(*task);
+            continue;
+        }
+
+        if(findWork(thread, context, throttled, WorkflowModule::PriorityCount))
+            return true;
+
+        // Ask consumers to wake us, then look again in case one made
+        // progress before the flag was set.
+        if(throttled)
+        {
+            m_throttled.store(true);
+
+            if(findWork(thread, context, throttled, WorkflowModule::PriorityCount))
+                return true;
+        }
+
+        // Block until something is queued after our search began
+        m_mutex.lock();
+        while(version == m_version && !thread->shuttingDown())
+            m_condition.wait(&m_mutex);
+        m_mutex.unlock();
+    }
+}
+
+void WorkScheduler::finishWork(WorkerThread *thread, const WorkContext &context,
+                               int64_t nsecs)
+{
+    WorkflowModule *module = context.module();
+
+    // Delivered to the workflow through queued connections. Only the worker
+    // which completes the job may touch the module after finishFrames(),
+    // as the module may be deleted once the job is done.
+    if(context.start() == 0 && context.count() > 0)
+        emit(module->firstFrameProcessed(module));
+
+    std::vector<WorkContext> runnable;
+
+    bool finished = context.job()->finishFrames(context.start(), context.count(),
+                                                nsecs, runnable);
+
+    // Released frames are still in this thread's cache, so do them next
+    for(auto it = runnable.rbegin(); it != runnable.rend(); ++it)
+        thread->pushWorkFront(*it);
+
+    if(runnable.size() > 0)
+        wakeOne();
+
+    if(m_throttled.exchange(false))
+        wakeAll();
+
+    if(finished)
+    {
+        emit(module->workFinished(module));
+
+        context.job()->setDone();
+    }
+}
+
+bool WorkScheduler::findWork(WorkerThread *thread, WorkContext &context, bool &throttled,
+                             int priorityLimit)
+{
+    QReadLocker locker(&m_threadLock);
+
+    int threadCount = (int) m_threads.size();
+
+    // Work of a more urgent class is stolen before our own less urgent work
+    // is started. This is where background jobs yield to interactive ones.
+    for(int priority = 0; priority < priorityLimit; ++priority)
+    {
+        if(thread->popWork(priority, context, throttled))
+            return true;
+
+        for(int offset = 1; offset < threadCount; ++offset)
+        {
+            WorkerThread *victim = m_threads[(thread->index() + offset) % threadCount];
+
+            // Requeue stolen work locally so that it is still taken in chunks
+            WorkContext stolen;
+            if(victim != thread && victim->stealWork(priority, stolen, throttled))
+            {
+                thread->pushWork(stolen);
+                return thread->popWork(priority, context, throttled);
+            }
+        }
+    }
+
+    return false;
+}
+
+void WorkScheduler::queueWork(const std::vector<WorkContext> &work)
+{
+    if(work.empty())
+        return;
+
+    {
+        QReadLocker locker(&m_threadLock);
+
+        int threadCount = (int) m_threads.size();
+
+        for(const WorkContext &context : work)
+        {
+            // Unsigned, so that the counter wrapping around stays in range
+            unsigned int next = (unsigned int) m_nextThread.fetch_add(1);
+            m_threads[next % threadCount]->pushWork(context);
+        }
+    }
+
+    wakeAll();
+}
+
+void WorkScheduler::wakeOne()
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_version;
+    m_condition.wakeOne();
+}
+
+void WorkScheduler::wakeAll()
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_version;
+    m_condition.wakeAll();
+}
+
+} // namespace emd
@@ -20,120 +20,170 @@
 
 #include "WorkerThread.h"
 
-#include "WorkContext.h"
+#include <iterator>
+
+#include <QElapsedTimer>
+
+#include "Trace.h"
 #include "WorkflowModule.h"
+#include "WorkScheduler.h"
 
 namespace emd
 {
 
-const int kMaxThreads = 1;
-
-bool WorkerThread::s_initialized = false;
+WorkerThread::WorkerThread(WorkScheduler *scheduler, int index, QObject *parent)
+    : QThread(parent),
+    m_scheduler(scheduler),
+    m_index(index),
+    m_shuttingDown(false)
+{
+    setObjectName(QString("Worker %1").arg(index));
+}
 
-std::vector<WorkerThread*> WorkerThread::s_freeThreads;
+WorkerThread::~WorkerThread()
+{
+    // The scheduler requests the shutdown and wakes the thread.
+    wait();
+}
 
-/******************************** Static Methods ********************************/
+int WorkerThread::index() const
+{
+    return m_index;
+}
 
-void WorkerThread::initialize()
+void WorkerThread::pushWork(const WorkContext &context)
 {
-    if(!s_initialized)
-    {
-        for(int iii = 0; iii < kMaxThreads; ++iii)
-        {
-            WorkerThread *thread = new WorkerThread();
-            s_freeThreads.push_back(thread);
-        } 
+    QMutexLocker locker(&m_mutex);
 
-        s_initialized = true;
-    }
+    m_queues[context.job()->priority()].push_back(context);
 }
 
-bool WorkerThread::available()
+void WorkerThread::pushWorkFront(const WorkContext &context)
 {
-    initialize();
+    QMutexLocker locker(&m_mutex);
 
-    return s_freeThreads.size() > 0;
+    m_queues[context.job()->priority()].push_front(context);
 }
 
-WorkerThread *WorkerThread::takeThread()
+bool WorkerThread::popWork(int priority, WorkContext &context, bool &throttled)
 {
-    initialize();
+    QMutexLocker locker(&m_mutex);
+
+    std::deque<WorkContext> &queue = m_queues[priority];
 
-    if(s_freeThreads.size() > 0)
+    for(auto it = queue.begin(); it != queue.end(); ++it)
     {
-        WorkerThread *thread = s_freeThreads.back();
+        // Cancelled ranges are taken whole, so the job is wound up quickly
+        bool cancelled = it->module()->cancelled();
+
+        if(!cancelled && it->job()->throttled(it->start()))
+        {
+            throttled = true;
+            continue;
+        }
+
+        int chunkSize = it->job()->chunkSize();
+
+        if(!cancelled && !it->job()->serial() && it->count() > chunkSize)
+        {
+            context = WorkContext(it->job(), it->start(), chunkSize);
 
-        s_freeThreads.pop_back();
+            it->setStart(it->start() + chunkSize);
+            it->setCount(it->count() - chunkSize);
+        }
+        else
+        {
+            context = *it;
+            queue.erase(it);
+        }
 
-        return thread;
+        return true;
     }
 
-    return NULL;
+    return false;
 }
 
-void WorkerThread::returnThread(WorkerThread *thread)
+bool WorkerThread::stealWork(int priority, WorkContext &context, bool &throttled)
 {
-    s_freeThreads.push_back(thread);
-}
+    QMutexLocker locker(&m_mutex);
 
-/******************************** Instance Methods *******************************/
+    std::deque<WorkContext> &queue = m_queues[priority];
 
-WorkerThread::WorkerThread(QObject *parent)
-	: QThread(parent),
-	m_shuttingDown(false),
-    m_context(NULL)
-{
-	m_shuttingDown = false;
-}
+    for(auto it = queue.rbegin(); it != queue.rend(); ++it)
+    {
+        if(!it->job()->serial() && it->count() >= 2)
+        {
+            int count = it->count() / 2;
+            int start = it->start() + it->count() - count;
 
-WorkerThread::~WorkerThread()
-{
-	m_mutex.lock();
-	m_shuttingDown = true;
-	m_condition.wakeOne();
-	m_mutex.unlock();
+            if(it->job()->throttled(start))
+            {
+                throttled = true;
+                continue;
+            }
 
-	wait();
-}
+            context = WorkContext(it->job(), start, count);
 
-void WorkerThread::work(WorkContext *context)
-{
-	QMutexLocker locker(&m_mutex);
+            it->setCount(it->count() - count);
+        }
+        else
+        {
+            if(it->job()->throttled(it->start()))
+            {
+                throttled = true;
+                continue;
+            }
 
-    if(m_context)
-        delete m_context;
+            context = *it;
+            queue.erase(std::next(it).base());
+        }
 
-    m_context = context;
+        return true;
+    }
+
+    return false;
+}
 
-    if(m_context)
+void WorkerThread::takeAllWork(std::deque<WorkContext> &work)
+{
+    QMutexLocker locker(&m_mutex);
+
+    for(std::deque<WorkContext> &queue : m_queues)
     {
-	    if(!isRunning())
-		    start(LowPriority);
-	    else 
-		    m_condition.wakeOne();
+        work.insert(work.end(), queue.begin(), queue.end());
+        queue.clear();
     }
 }
 
+bool WorkerThread::shuttingDown() const
+{
+    return m_shuttingDown.load();
+}
+
+void WorkerThread::requestShutdown()
+{
+    m_shuttingDown.store(true);
+}
+
 void WorkerThread::run()
 {
-	forever
-	{
-		m_mutex.lock();
-		// If there are no frames to process, block until there are
-		if(!m_context)
-			m_condition.wait(&m_mutex);
-		if(m_shuttingDown)
-			return;
-		
-		m_context->module()->doWork(m_context);
-
-        delete m_context;
-        m_context = NULL;
-
-		m_mutex.unlock();
-
-		emit(finishedProcessing(this));
-	}
+    WorkContext context;
+
+    // takeWork() blocks until there is work, and returns false on shutdown
+    while(m_scheduler->takeWork(this, context))
+    {
+        EMD_TRACE_ZONE("WorkerThread::run");
+
+        QElapsedTimer timer;
+        timer.start();
+
+        context.module()->doWork(&context);
+
+        m_scheduler->finishWork(this, context, timer.nsecsElapsed());
+
+        // Release the job before blocking again
+        context = WorkContext();
+    }
 }
 
 } // namespace emd
@@ -24,14 +24,17 @@
 
 #include <qboxlayout.h>
 #include <QDebug>
+#include <QElapsedTimer>
+#include <qgroupbox.h>
 #include <qlabel.h>
 #include <qwidget.h>
 
 #include <QtXml>
 
 #include "Frame.h"
+#include "FrameBufferPool.h"
 #include "ProcessingContext.h"
-#include "WorkerThread.h"
+#include "WorkContext.h"
 #include "WorkflowModule.h"
 #include "WorkflowSource.h"
 
@@ -40,6 +43,40 @@ namespace emd
 
 /***************************** Static Methods ********************************/
 
+// Runs shorter than this are interactive updates and aren't summarized in
+// the log.
+static const qint64 kSummaryTime = 500;     // In milliseconds
+
+static QString moduleDisplayName(WorkflowModule *module)
+{
+    if(!module->name().isEmpty())
+        return module->name();
+
+    return QString(module->metaObject()->className()).section("::", -1);
+}
+
+static QString statisticsText(const ModuleStatistics &statistics)
+{
+    return QString("%1 / %2 / %3 ms, %4 frames, %5 / %6 MB, %7% of %8 threads")
+        .arg(statistics.preprocessTime * 1e-6, 0, 'f', 1)
+        .arg(statistics.processTime * 1e-6, 0, 'f', 1)
+        .arg(statistics.postprocessTime * 1e-6, 0, 'f', 1)
+        .arg(statistics.frameCount)
+        .arg(statistics.bytesIn / 1048576., 0, 'f', 1)
+        .arg(statistics.bytesOut / 1048576., 0, 'f', 1)
+        .arg((int) (100. * statistics.utilisation()))
+        .arg(statistics.threadCount);
+}
+
+static QString poolStatisticsText(const FrameBufferPool::Statistics &statistics)
+{
+    return QString("%1% of %2 buffers reused, %3 MB peak, %4 MB idle")
+        .arg((int) (100. * statistics.reuseRate()))
+        .arg(statistics.requests)
+        .arg(statistics.peakBytes / 1048576., 0, 'f', 1)
+        .arg(statistics.idleBytes / 1048576., 0, 'f', 1);
+}
+
 static std::map<std::string, std::map<std::string, WorkflowSource *>> s_workflowMaps;
 static std::map<std::string, std::string> s_workflowDescriptions;
 
@@ -150,13 +187,25 @@ std::string Workflow::description(const std::string &group, const std::string &n
 Workflow::Workflow(const QString &name)
     : m_active(false),
     m_paused(false),
-    m_name(name)
+    m_launching(false),
+    m_relaunch(false),
+    m_name(name),
+    m_bufferPool(std::make_shared<FrameBufferPool>())
 {
 
 }
 
 Workflow::~Workflow()
 {
+    // Modules may still have jobs on the workers, which read from the
+    // dataset and from each other. All are cancelled before any is waited
+    // for, so that streamed consumers don't hold their producers up.
+    for(WorkflowModule *module : m_modules)
+        module->cancel();
+
+    for(WorkflowModule *module : m_modules)
+        module->cancelAndWait();
+
 	for(WorkflowModule *module : m_modules)
 		module->deleteLater();
 }
@@ -181,17 +230,39 @@ void Workflow::addModule(WorkflowModule *module)
     // TODO: should automatically add all attached modules?
 	m_modules.append(module);
 
+    module->setBufferPool(m_bufferPool);
+
 	connect(module, SIGNAL(moduleOutdated(WorkflowModule *)),
 		this, SLOT(moduleOutdated(WorkflowModule *)));
 	connect(module, SIGNAL(workFinished(WorkflowModule *)),
 		this, SLOT(moduleFinishedProcessing(WorkflowModule *)));
+	connect(module, SIGNAL(firstFrameProcessed(WorkflowModule *)),
+		this, SLOT(moduleFirstFrameProcessed(WorkflowModule *)));
 }
 
 void Workflow::removeModule(WorkflowModule *module)
 {
     m_modules.removeAll(module);
 
+    // Nothing may reach the module through the run state once it's gone,
+    // e.g. the timing summary.
+    bool running = (m_runningModules.removeAll(module) > 0);
+    m_modulesToProcess.removeAll(module);
+    m_streamedModules.remove(module);
+    m_continuedModules.removeAll(module);
+    m_finishedModules.removeAll(module);
+
+    disconnect(module, 0, this, 0);
+
+    // A run in progress would never be reported as finished
+    if(running)
+        module->cancel();
+
     module->detach();
+    module->setBufferPool(std::shared_ptr<FrameBufferPool>());
+
+    if(running && m_active)
+        processNextModule();
 }
 
 const QList<WorkflowModule *> &Workflow::modules() const
@@ -199,6 +270,11 @@ const QList<WorkflowModule *> &Workflow::modules() const
 	return m_modules;
 }
 
+const std::shared_ptr<FrameBufferPool> &Workflow::bufferPool() const
+{
+    return m_bufferPool;
+}
+
 
 bool Workflow::paused() const
 {
@@ -250,6 +326,42 @@ QWidget *Workflow::controlWidget()
     if(layout->count() == 0)
         return NULL;
 
+    // Timings of each module's last run: pre/process/post, frames, bytes
+    // in/out and worker utilisation.
+    QVBoxLayout *statisticsLayout = new QVBoxLayout();
+
+    QLabel *poolLabel = new QLabel("Buffer pool: -");
+    poolLabel->setWordWrap(true);
+
+    std::shared_ptr<FrameBufferPool> pool = m_bufferPool;
+
+    for(WorkflowModule *module : m_modules)
+    {
+        QLabel *label = new QLabel(moduleDisplayName(module) + ": -");
+        label->setWordWrap(true);
+        statisticsLayout->addWidget(label);
+
+        connect(module, &WorkflowModule::statisticsUpdated, label,
+            [label](WorkflowModule *updated)
+        {
+            label->setText(moduleDisplayName(updated) + ": "
+                + statisticsText(updated->statistics()));
+        });
+
+        connect(module, &WorkflowModule::statisticsUpdated, poolLabel,
+            [poolLabel, pool](WorkflowModule *)
+        {
+            poolLabel->setText("Buffer pool: " + poolStatisticsText(pool->statistics()));
+        });
+    }
+
+    statisticsLayout->addWidget(poolLabel);
+
+    QGroupBox *statisticsGroup = new QGroupBox("Timing");
+    statisticsGroup->setFlat(true);
+    statisticsGroup->setLayout(statisticsLayout);
+    layout->addWidget(statisticsGroup);
+
     QWidget *controlWidget = new QWidget();
     //controlWidget->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Preferred);
     controlWidget->setLayout(layout);
@@ -289,6 +401,7 @@ void Workflow::start()
     }
 
 	m_active = true;
+    m_runTimer.start();
 
 	processNextModule();
 }
@@ -483,44 +596,221 @@ bool Workflow::load(const QString &path)
 
 void Workflow::processNextModule()
 {
-    WorkflowModule *nextModule = NULL;
-
-    if(m_modulesToProcess.count() == 0)
+    // A module finishing synchronously inside process() lands back here;
+    // let the outer call pick up whatever it made ready.
+    if(m_launching)
     {
-        finish();
+        m_relaunch = true;
         return;
     }
 
-	while(!nextModule || !nextModule->validate() 
-        || !nextModule->active() || !nextModule->enabled())
+    m_launching = true;
+
+    do
+    {
+        m_relaunch = false;
+        launchReadyModules();
+
+        // Continued modules wait until the whole workflow is idle, so at
+        // most one of their runs is held in memory at a time.
+        if(!m_relaunch && m_modulesToProcess.count() == 0 && m_runningModules.count() == 0
+           && m_continuedModules.count() > 0)
+        {
+            m_modulesToProcess.append(m_continuedModules);
+            m_continuedModules.clear();
+            m_relaunch = true;
+        }
+    } while(m_relaunch);
+
+    m_launching = false;
+
+    if(m_modulesToProcess.count() == 0 && m_runningModules.count() == 0)
+        finish();
+}
+
+void Workflow::launchReadyModules()
+{
+    int index = 0;
+
+	while(index < m_modulesToProcess.count())
 	{
-        if(nextModule)
+        WorkflowModule *nextModule = m_modulesToProcess.at(index);
+
+        if(m_runningModules.contains(nextModule) || inputPending(nextModule)
+           || outputRunning(nextModule))
         {
-            if(nextModule->validate() && nextModule->enabled())
+            ++index;
+            continue;
+        }
+
+        m_modulesToProcess.removeAt(index);
+
+        if(!nextModule->validate() || !nextModule->enabled())
+            continue;
+
+        // Inactive modules pass their input straight to their outputs.
+        // Active modules in the streamed set have already been run.
+        if(!nextModule->active() || m_streamedModules.contains(nextModule))
+        {
+            if(!nextModule->active())
             {
                 QList<WorkflowModule*> outputModules = nextModule->outputModules();
 
-                for(int index = 0; index < outputModules.count(); ++index)
+                for(int output = 0; output < outputModules.count(); ++output)
                 {
-                    m_modulesToProcess.insert(index, outputModules.at(index));
+                    m_modulesToProcess.insert(index + output, outputModules.at(output));
                 }
             }
+
+            m_streamedModules.remove(nextModule);
+            continue;
         }
 
-		if(m_modulesToProcess.count() > 0)
-		{
-			nextModule = m_modulesToProcess.takeFirst();
-		}
-		else
-		{
-            finish();
-            return;
-		}
+        m_runningModules.append(nextModule);
+
+        QElapsedTimer timer;
+        timer.start();
+	    nextModule->preprocess();
+        nextModule->beginStatistics(timer.nsecsElapsed());
+
+	    nextModule->process();
+
+        // process() may have finished synchronously and changed the list
+        index = 0;
 	}
+}
+
+bool Workflow::inputPending(WorkflowModule *module) const
+{
+    QList<WorkflowModule*> inputs = module->inputModules();
+    QSet<WorkflowModule*> visited;
+
+    while(inputs.count() > 0)
+    {
+        WorkflowModule *input = inputs.takeFirst();
+
+        if(visited.contains(input))
+            continue;
+        visited.insert(input);
 
-	nextModule->preprocess();
+        if(m_runningModules.contains(input) || m_modulesToProcess.contains(input))
+            return true;
 
-	nextModule->process();
+        inputs.append(input->inputModules());
+    }
+
+    return false;
+}
+
+bool Workflow::outputRunning(WorkflowModule *module) const
+{
+    QList<WorkflowModule*> outputs = module->outputModules();
+    QSet<WorkflowModule*> visited;
+
+    while(outputs.count() > 0)
+    {
+        WorkflowModule *output = outputs.takeFirst();
+
+        if(visited.contains(output))
+            continue;
+        visited.insert(output);
+
+        if(m_runningModules.contains(output))
+            return true;
+
+        outputs.append(output->outputModules());
+    }
+
+    return false;
+}
+
+void Workflow::streamOutputs(WorkflowModule *module, const std::shared_ptr<WorkJob> &job,
+                             bool configure)
+{
+	QList<WorkflowModule*> outputModules = module->outputModules();
+
+    for(WorkflowModule *output : outputModules)
+    {
+        if(!output->enabled() || output->inputMode() == WorkflowModule::InputBarrier)
+            continue;
+
+        // Restarting a module resets the context its own outputs read from
+        if(m_runningModules.contains(output) || m_modulesToProcess.contains(output)
+           || m_streamedModules.contains(output) || outputRunning(output))
+            continue;
+
+        // Inactive modules have already forwarded the context to their outputs
+        if(configure)
+            module->configureOutputModule(output);
+
+        m_streamedModules.insert(output);
+
+        if(!output->validate())
+            continue;
+
+        if(!output->active())
+        {
+            streamOutputs(output, job, false);
+            continue;
+        }
+
+        m_runningModules.append(output);
+
+        output->setInputJob(job);
+        output->preprocess();
+        output->process();
+    }
+}
+
+void Workflow::supersede(WorkflowModule *module)
+{
+    // The module and everything downstream of it is working on stale input
+    QList<WorkflowModule*> stale;
+    QList<WorkflowModule*> modules;
+    modules.append(module);
+
+    while(modules.count() > 0)
+    {
+        WorkflowModule *next = modules.takeFirst();
+
+        if(stale.contains(next))
+            continue;
+        stale.append(next);
+
+        modules.append(next->outputModules());
+    }
+
+    QList<WorkflowModule*> cancelled;
+
+    for(WorkflowModule *running : m_runningModules)
+    {
+        if(!stale.contains(running))
+            continue;
+
+        // Streaming consumers need every frame of their producer, so one
+        // module which can't be cancelled keeps the whole run going.
+        if(!running->cancellable())
+            return;
+
+        cancelled.append(running);
+    }
+
+    for(WorkflowModule *running : cancelled)
+        running->cancel();
+}
+
+void Workflow::forgetStreamedOutputs(WorkflowModule *module)
+{
+    for(WorkflowModule *output : module->outputModules())
+    {
+        if(!m_streamedModules.contains(output))
+            continue;
+
+        m_streamedModules.remove(output);
+
+        if(!output->active())
+            forgetStreamedOutputs(output);
+    }
 }
 
 bool Workflow::findInputModules(QList<WorkflowModule*> &inputModules)
@@ -544,6 +834,25 @@ void Workflow::finish()
 {
     m_active = false;
 
+    m_streamedModules.clear();
+
+    if(m_runTimer.elapsed() >= kSummaryTime && m_finishedModules.count() > 0)
+    {
+        qDebug() << QString("Workflow %1.%2 finished in %3 ms (pre / process / post, "
+            "frames, MB in / out, utilisation)").arg(m_group).arg(m_name).arg(m_runTimer.elapsed());
+
+        for(WorkflowModule *module : m_finishedModules)
+        {
+            qDebug() << QString("  %1: %2").arg(moduleDisplayName(module))
+                .arg(statisticsText(module->statistics()));
+        }
+
+        qDebug() << QString("  Buffer pool: %1")
+            .arg(poolStatisticsText(m_bufferPool->statistics()));
+    }
+
+    m_finishedModules.clear();
+
     emit(finishedProcessing());
 }
 
@@ -554,10 +863,16 @@ void Workflow::moduleOutdated(WorkflowModule *module)
 	if(!m_modulesToProcess.contains(module))
     {
         m_modulesToProcess.append(module);
+        m_streamedModules.remove(module);
+        m_continuedModules.removeAll(module);
+
+        if(m_active)
+            supersede(module);
 
 	    if(!m_active && !m_paused)
         {
             m_active = true;
+            m_runTimer.start();
             processNextModule();
         }
     }
@@ -570,22 +885,74 @@ void Workflow::moduleFinishedProcessing(WorkflowModule *module)
     // then it needs to be reprocessed?
     //m_modulesToProcess.removeAll(module);
 
+    m_runningModules.removeAll(module);
+
+    // A superseded run is dropped; the module is already queued again
+    if(module->cancelled())
+    {
+        module->discardResults();
+        forgetStreamedOutputs(module);
+
+        processNextModule();
+        return;
+    }
+
+    module->endProcessStatistics();
+
+    QElapsedTimer timer;
+    timer.start();
     module->postprocess();
+    module->endStatistics(timer.nsecsElapsed());
+
+    if(!m_finishedModules.contains(module))
+        m_finishedModules.append(module);
+
+    if(module->hasNextRun() && !m_continuedModules.contains(module))
+        m_continuedModules.append(module);
 
 	QList<WorkflowModule*> outputModules = module->outputModules();
+    int insertIndex = 0;
 
     for(int index = 0; index < outputModules.count(); ++index)
     {
         WorkflowModule *output = outputModules.at(index);
 
-        module->configureOutputModule(output);
+        // Streamed outputs were configured when they started, and may
+        // still be reading the context. Inactive ones are still queued so
+        // that any barrier modules behind them run.
+        if(m_streamedModules.contains(output))
+        {
+            if(output->active())
+            {
+                m_streamedModules.remove(output);
+                continue;
+            }
+        }
+        else
+        {
+            module->configureOutputModule(output);
+        }
 
         if(output->enabled() && output->validate())
-            m_modulesToProcess.insert(index, output);
+            m_modulesToProcess.insert(insertIndex++, output);
     }
 
 	processNextModule();
 }
 
+void Workflow::moduleFirstFrameProcessed(WorkflowModule *module)
+{
+    // The module may have finished before this was delivered
+    if(!m_runningModules.contains(module) || module->cancelled())
+        return;
+
+    std::shared_ptr<WorkJob> job = module->job();
+
+    if(!job || !job->frameFinished(0))
+        return;
+
+    streamOutputs(module, job, true);
+}
+
 } // namespace emd
 
@@ -20,21 +20,101 @@
 
 #include "WorkflowModule.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <QDomElement>
+#include <QMutex>
 
 #include "Frame.h"
+#include "FrameBufferPool.h"
+#include "FrameCache.h"
 #include "ModuleSource.h"
+#include "PixelKernels.h"
+#include "Trace.h"
+#include "Util.h"
 #include "WorkContext.h"
-#include "WorkerThread.h"
+#include "WorkScheduler.h"
 
 namespace emd
 {
 
 EMD_MODULE_DEFINITION(WorkflowModule)
 
-static const unsigned int MAX_FRAMES_PER_THREAD = UINT_MAX;
+// Tiled runs cut each frame into this many tiles per worker thread, so that
+// uneven tiles balance out.
+static const int kTilesPerThread = 2;
+
+// Smaller tiles aren't worth waking a worker for.
+static const int64_t kMinTileSize = 32768;
+
+// Frames are repacked in square blocks of this many elements a side, so
+// that the lines of a block stay in L1 on both sides of a transpose.
+static const int kRepackBlockSize = 64;
+
+template <typename T>
+static void repackBlocked(const T *input, int hStep, int vStep,
+                          T *output, int outputHStep, int outputVStep,
+                          int hSize, int vSize)
+{
+    for(int vBlock = 0; vBlock < vSize; vBlock += kRepackBlockSize)
+    {
+        int vEnd = std::min(vBlock + kRepackBlockSize, vSize);
+
+        for(int hBlock = 0; hBlock < hSize; hBlock += kRepackBlockSize)
+        {
+            int hEnd = std::min(hBlock + kRepackBlockSize, hSize);
+
+            for(int jjj = vBlock; jjj < vEnd; ++jjj)
+            {
+                const T *in = input + (int64_t) jjj * vStep;
+                T *out = output + (int64_t) jjj * outputVStep;
+
+                for(int iii = hBlock; iii < hEnd; ++iii)
+                    out[(int64_t) iii * outputHStep] = in[(int64_t) iii * hStep];
+            }
+        }
+    }
+}
+
+// Only the element size matters to a copy
+static void repackBlocked(int depth, const void *input, int hStep, int vStep,
+                          void *output, int outputHStep, int outputVStep,
+                          int hSize, int vSize)
+{
+    switch(depth)
+    {
+    case 1:
+        repackBlocked((const uint8_t *) input, hStep, vStep,
+                      (uint8_t *) output, outputHStep, outputVStep, hSize, vSize);
+        break;
+    case 2:
+        repackBlocked((const uint16_t *) input, hStep, vStep,
+                      (uint16_t *) output, outputHStep, outputVStep, hSize, vSize);
+        break;
+    case 4:
+        repackBlocked((const uint32_t *) input, hStep, vStep,
+                      (uint32_t *) output, outputHStep, outputVStep, hSize, vSize);
+        break;
+    case 8:
+        repackBlocked((const uint64_t *) input, hStep, vStep,
+                      (uint64_t *) output, outputHStep, outputVStep, hSize, vSize);
+        break;
+    default:
+        qWarning() << "Can't repack elements of" << depth << "bytes";
+        break;
+    }
+}
+
+static int64_t contextBytes(const ProcessingContext &context)
+{
+    int64_t bytes = 0;
+
+    for(int index = 0; index < context.frameCount(); ++index)
+        bytes += FrameCache::frameBytes(context.frameAtIndex(index));
+
+    return bytes;
+}
 
 /***************************** Static Methods ********************************/
 
@@ -147,14 +227,18 @@ WorkflowModule::WorkflowModule()
 	m_outdated(true),
 	m_enabled(true),
     m_active(true),
-    m_controlDisplayed(true)
+    m_controlDisplayed(true),
+    m_cancelled(false),
+    m_tileCount(1)
 {
     setProperty("ControlDisplayed", "true");
 }
 
 WorkflowModule::~WorkflowModule()
 {
-    
+    // Workflows wait before deleting their modules. This only covers the
+    // base class of modules deleted on their own.
+    cancelAndWait();
 }
 
 bool WorkflowModule::validate() const
@@ -321,6 +405,109 @@ WorkflowModule::RequiredFeatures WorkflowModule::requiredFeatures() const
     return NoFeatures;
 }
 
+WorkflowModule::ConcurrencyMode WorkflowModule::concurrencyMode() const
+{
+    return ConcurrencySerial;
+}
+
+WorkflowModule::InputMode WorkflowModule::inputMode() const
+{
+    return InputStreaming;
+}
+
+WorkflowModule::WorkPriority WorkflowModule::workPriority() const
+{
+    return PriorityInteractive;
+}
+
+WorkflowModule::FrameLayout WorkflowModule::inputLayout() const
+{
+    return LayoutAny;
+}
+
+bool WorkflowModule::cancellable() const
+{
+    return true;
+}
+
+bool WorkflowModule::hasNextRun() const
+{
+    return false;
+}
+
+void WorkflowModule::cancel()
+{
+    m_cancelled.store(true);
+}
+
+bool WorkflowModule::cancelled() const
+{
+    return m_cancelled.load();
+}
+
+void WorkflowModule::cancelAndWait()
+{
+    cancel();
+
+    if(m_job)
+        m_job->wait();
+}
+
+void WorkflowModule::discardResults()
+{
+
+}
+
+const ModuleStatistics &WorkflowModule::statistics() const
+{
+    return m_statistics;
+}
+
+const std::shared_ptr<FrameBufferPool> &WorkflowModule::bufferPool() const
+{
+    return m_bufferPool;
+}
+
+void WorkflowModule::setBufferPool(const std::shared_ptr<FrameBufferPool> &pool)
+{
+    m_bufferPool = pool;
+}
+
+void WorkflowModule::beginStatistics(int64_t preprocessTime)
+{
+    m_runStatistics = ModuleStatistics();
+    m_runStatistics.preprocessTime = preprocessTime;
+
+    m_processTimer.start();
+}
+
+void WorkflowModule::endProcessStatistics()
+{
+    m_runStatistics.processTime = m_processTimer.nsecsElapsed();
+    m_runStatistics.threadCount = WorkScheduler::instance().threadCount();
+
+    if(m_job)
+    {
+        m_runStatistics.workTime = m_job->workTime();
+        m_runStatistics.frameCount = m_job->frameCount();
+    }
+    else
+    {
+        m_runStatistics.frameCount = m_outputContext.frameCount();
+    }
+}
+
+void WorkflowModule::endStatistics(int64_t postprocessTime)
+{
+    m_runStatistics.postprocessTime = postprocessTime;
+    m_runStatistics.bytesIn = contextBytes(m_inputContext);
+    m_runStatistics.bytesOut = contextBytes(m_outputContext);
+
+    m_statistics = m_runStatistics;
+
+    emit(statisticsUpdated(this));
+}
+
 void WorkflowModule::preprocess()
 {
     
@@ -328,36 +515,38 @@ void WorkflowModule::preprocess()
 
 Frame *WorkflowModule::processFrame(Frame *frame, int /*index*/)
 {
-    // The output frame is a copy of the input frame, except that it doesn't
-    // own the data.
-    return new Frame(frame->data<void>(), frame->dataType(), false);
+    return frame;
 }
 
 void WorkflowModule::process()
 {
-	m_activeThreadCount = 0;
-    m_frameIndex = 0;
-    
+    m_cancelled.store(false);
+
     m_outputContext.reset();
     m_outputContext.init(m_inputContext.frameCount());
-	
-	WorkerThread *thread = NULL;
-    WorkContext *context = NULL;
 
-    while(WorkerThread::available() && (context = this->workContext()) )
-	{
-        thread = WorkerThread::takeThread();
+    // With fewer frames than threads, the remaining threads work on tiles
+    int threadCount = WorkScheduler::instance().threadCount();
+    int frameCount = m_inputContext.frameCount();
 
-		connect(thread, SIGNAL(finishedProcessing(WorkerThread *)),
-			this, SLOT(scheduleWork(WorkerThread *)));
-		++m_activeThreadCount;
+    if(frameCount > 0 && frameCount < threadCount)
+        m_tileCount = kTilesPerThread * ((threadCount + frameCount - 1) / frameCount);
+    else
+        m_tileCount = 1;
 
-        thread->work(context);
-	}
+    std::shared_ptr<WorkJob> inputJob = m_inputJob;
+    m_inputJob.reset();
 
-    // If we didn't schedule any threads, we're finished
-    if(m_activeThreadCount == 0)
+    // If there is nothing to schedule, we're finished
+    if(m_inputContext.frameCount() == 0)
+    {
+        m_job.reset();
         emit(workFinished(this));
+    }
+    else
+    {
+        m_job = WorkScheduler::instance().schedule(this, m_inputContext.frameCount(), inputJob);
+    }
 }
 
 void WorkflowModule::postprocess()
@@ -379,74 +568,265 @@ void WorkflowModule::configureOutputModule(WorkflowModule *next)
     next->setInputContext(m_outputContext, this);
 }
 
-void WorkflowModule::scheduleWork(WorkerThread *thread)
-{	
-    WorkContext *context = this->workContext();
+const std::shared_ptr<WorkJob> &WorkflowModule::job() const
+{
+    return m_job;
+}
 
-	if(context)
-	{
-		thread->work(context);
-	}
-	else
-	{
-		// If there are no frames left, return the thread
-		disconnect(thread, SIGNAL(finishedProcessing(WorkerThread *)),
-			this, SLOT(scheduleWork(WorkerThread *)));
+void WorkflowModule::setInputJob(const std::shared_ptr<WorkJob> &job)
+{
+    m_inputJob = job;
+}
 
-		WorkerThread::returnThread(thread);
-		--m_activeThreadCount;
+void WorkflowModule::doWork(WorkContext *context)
+{
+    // The class name is static, so it can serve as the zone name
+    EMD_TRACE_ZONE(metaObject()->className());
 
-		if(m_activeThreadCount == 0)
-			emit(workFinished(this));
-	}
+    for(int index = context->start(); index < context->start() + context->count(); ++index)
+    {
+        // The rest of the range counts as done; the results are dropped
+        if(cancelled())
+            break;
+
+        if(index < m_inputContext.frameCount())
+        {
+            std::shared_ptr<Frame> input = m_inputContext.sharedFrameAtIndex(index);
+
+            if(input)
+            {
+                std::shared_ptr<Frame> output = processSharedFrame(input, index);
+
+                if(output)
+                    m_outputContext.setSharedFrameAtIndex(output, index);
+            }
+        }
+        else
+        {
+            qWarning() << "Invalid input index (" << index << ") in " << this->name();
+        }
+    }
 }
 
-WorkContext *WorkflowModule::workContext()
+std::shared_ptr<Frame> WorkflowModule::processSharedFrame(const std::shared_ptr<Frame> &input,
+                                                          int index)
 {
-    int remainingFrames = m_inputContext.frameCount() - m_frameIndex;
+    // The kernels run their rows at unit stride, so every caller gets the
+    // layout processFrame() asks for
+    FrameLayout layout = inputLayout();
+
+    std::shared_ptr<Frame> frame = input;
+    if(frame && layout != LayoutAny)
+        frame = normaliseLayout(frame, layout);
+
+    if(!frame)
+        return std::shared_ptr<Frame>();
 
-    if(remainingFrames <= 0)
-        return NULL;
+    Frame *outputFrame = this->processFrame(frame.get(), index);
 
-    WorkContext *context = new WorkContext(this);
-    // If there are unprocessed frames remaining, process them
-	uint64_t frameCount = remainingFrames < MAX_FRAMES_PER_THREAD ?
-	                        remainingFrames : MAX_FRAMES_PER_THREAD;
+    if(outputFrame == frame.get())
+        return frame;
 
-    context->setStart(m_frameIndex);
-    context->setCount(frameCount);
+    if(!outputFrame)
+        return std::shared_ptr<Frame>();
 
-    m_frameIndex += frameCount;
+    outputFrame->setIndex(frame->index());
 
-    return context;
+    return shareFrame(outputFrame);
 }
 
-void WorkflowModule::doWork(WorkContext *context)
+void WorkflowModule::processTiles(int lineCount, int lineLength,
+                                  const std::function<void(int, int)> &function) const
 {
-    for(int index = context->start(); index < context->start() + context->count(); ++index)
+    int64_t tileCount = m_tileCount;
+
+    if(tileCount > ((int64_t) lineCount * lineLength) / kMinTileSize)
+        tileCount = ((int64_t) lineCount * lineLength) / kMinTileSize;
+
+    if(tileCount > lineCount)
+        tileCount = lineCount;
+
+    if(tileCount <= 1)
     {
-        if(index < m_inputContext.frameCount())
+        function(0, lineCount);
+        return;
+    }
+
+    WorkScheduler::instance().runTiles(workPriority(), (int) tileCount, [&](int tile)
+    {
+        if(cancelled())
+            return;
+
+        int begin = (int) ((int64_t) lineCount * tile / tileCount);
+        int end = (int) ((int64_t) lineCount * (tile + 1) / tileCount);
+
+        function(begin, end);
+    });
+}
+
+template <typename T>
+void WorkflowModule::getDataRange(Frame *frame, T &min, T &max) const
+{
+    Frame::Data<T> data = frame->data<T>();
+
+    if(m_tileCount <= 1 || data.imaginary || data.size() == 0)
+    {
+        frame->getDataRange(min, max);
+        return;
+    }
+
+    min = max = data.real[0];
+
+    QMutex mutex;
+
+    processTiles(data.vSize, data.hSize, [&](int begin, int end)
+    {
+        T tileMin = data.real[begin * data.vStep];
+        T tileMax = tileMin;
+
+        for(int jjj = begin; jjj < end; ++jjj)
         {
-            Frame *outputFrame = NULL;
-            if(m_inputContext.frameAtIndex(index))
+            if(data.hStep == 1)
             {
-	            outputFrame = this->processFrame(m_inputContext.frameAtIndex(index), index);
+                RangeKernel<T>::run(data.real + jjj * data.vStep, data.hSize, tileMin, tileMax);
+                continue;
             }
 
-            if(outputFrame)
+            int kkk = jjj * data.vStep;
+
+            for(int iii = 0; iii < data.hSize; ++iii)
             {
-                outputFrame->setIndex(m_inputContext.frameAtIndex(index)->index());
+                if(data.real[kkk] < tileMin)
+                    tileMin = data.real[kkk];
+                else if(data.real[kkk] > tileMax)
+                    tileMax = data.real[kkk];
 
-                m_outputContext.setFrameAtIndex(outputFrame, index);
+                kkk += data.hStep;
             }
         }
-        else
-        {
-            qWarning() << "Invalid input index (" << index << ") in " << this->name();
-        }
+
+        // Merge the tile's range into the frame's
+        QMutexLocker locker(&mutex);
+
+        if(tileMin < min)
+            min = tileMin;
+        if(tileMax > max)
+            max = tileMax;
+    });
+}
+
+void *WorkflowModule::allocateBuffer(int64_t bytes)
+{
+    if(m_bufferPool)
+        return m_bufferPool->acquire(bytes);
+
+    return qMallocAligned((size_t) bytes, 64);
+}
+
+void WorkflowModule::releaseBuffer(void *buffer)
+{
+    FrameBufferPool::release(m_bufferPool, buffer);
+}
+
+Frame *WorkflowModule::createFrame(const Frame::Data<void> &data, DataType type)
+{
+    Frame *frame = new Frame(data, type, false);
+
+    QMutexLocker locker(&m_pooledFramesMutex);
+    m_pooledFrames[frame] = std::make_pair(data.real, data.imaginary);
+
+    return frame;
+}
+
+QImage *WorkflowModule::createImage(int width, int height, QImage::Format format)
+{
+    if(m_bufferPool)
+        return m_bufferPool->image(width, height, format);
+
+    return new QImage(width, height, format);
+}
+
+std::shared_ptr<Frame> WorkflowModule::shareFrame(Frame *frame)
+{
+    std::pair<void *, void *> buffers;
+
+    {
+        QMutexLocker locker(&m_pooledFramesMutex);
+
+        auto it = m_pooledFrames.find(frame);
+        if(it == m_pooledFrames.end())
+            return std::shared_ptr<Frame>(frame);
+
+        buffers = it->second;
+        m_pooledFrames.erase(it);
+    }
+
+    // The pool may be gone by the time the frame is
+    std::weak_ptr<FrameBufferPool> pool = m_bufferPool;
+
+    return std::shared_ptr<Frame>(frame, [pool, buffers](Frame *frame)
+    {
+        delete frame;
+
+        FrameBufferPool::release(pool, buffers.first);
+        FrameBufferPool::release(pool, buffers.second);
+    });
+}
+
+std::shared_ptr<Frame> WorkflowModule::normaliseLayout(const std::shared_ptr<Frame> &frame,
+                                                       FrameLayout layout)
+{
+    Frame::Data<void> data = frame->data<void>();
+
+    int hStep = 1, vStep = data.hSize;
+    if(layout == LayoutColumnMajor)
+    {
+        hStep = data.vSize;
+        vStep = 1;
     }
+
+    // Padding between lines doesn't get in the way of unit-stride loops
+    bool unitStride = (layout == LayoutRowMajor) ? (data.hStep == 1) : (data.vStep == 1);
+    if(layout == LayoutAny || unitStride || data.size() <= 1)
+        return frame;
+
+    EMD_TRACE_ZONE("WorkflowModule::normaliseLayout");
+
+    int depth = emdTypeDepth(frame->dataType());
+    int64_t bytes = (int64_t) data.size() * depth;
+
+    void *real = allocateBuffer(bytes);
+    void *imaginary = data.imaginary ? allocateBuffer(bytes) : nullptr;
+
+    repackBlocked(depth, data.real, data.hStep, data.vStep,
+                  real, hStep, vStep, data.hSize, data.vSize);
+
+    if(imaginary)
+    {
+        repackBlocked(depth, data.imaginary, data.hStep, data.vStep,
+                      imaginary, hStep, vStep, data.hSize, data.vSize);
+    }
+
+    Frame::Data<void> repacked(data.attributes, hStep, vStep, data.hSize, data.vSize,
+                               real, imaginary);
+
+    Frame *repackedFrame = createFrame(repacked, frame->dataType());
+    repackedFrame->setIndex(frame->index());
+
+    return shareFrame(repackedFrame);
 }
 
+template void WorkflowModule::getDataRange<int8_t>(Frame *, int8_t &, int8_t &) const;
+template void WorkflowModule::getDataRange<int16_t>(Frame *, int16_t &, int16_t &) const;
+template void WorkflowModule::getDataRange<int32_t>(Frame *, int32_t &, int32_t &) const;
+template void WorkflowModule::getDataRange<int64_t>(Frame *, int64_t &, int64_t &) const;
+template void WorkflowModule::getDataRange<uint8_t>(Frame *, uint8_t &, uint8_t &) const;
+template void WorkflowModule::getDataRange<uint16_t>(Frame *, uint16_t &, uint16_t &) const;
+template void WorkflowModule::getDataRange<uint32_t>(Frame *, uint32_t &, uint32_t &) const;
+template void WorkflowModule::getDataRange<uint64_t>(Frame *, uint64_t &, uint64_t &) const;
+template void WorkflowModule::getDataRange<float>(Frame *, float &, float &) const;
+template void WorkflowModule::getDataRange<double>(Frame *, double &, double &) const;
+
 /********************************* Base class methods ********************************/
 
 QString WorkflowModule::name() const
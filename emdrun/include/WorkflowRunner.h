@@ -0,0 +1,112 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef EMD_WORKFLOWRUNNER_H
+#define EMD_WORKFLOWRUNNER_H
+
+#include <stdint.h>
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+
+#include "BinaryOutputModule.h"
+#include "FrameSet.h"
+#include "ModuleSource.h"
+
+namespace emd
+{
+
+class BinaryExport;
+class DataGroup;
+class Frame;
+class ImageWindowModule;
+class Model;
+class Plugin;
+class Workflow;
+
+// Runs a saved workflow over a data group without any of the viewer's UI.
+// The frames reaching the workflow's main image output are diverted to a
+// BinaryOutputModule and written to disk, as in the viewer's binary export.
+class WorkflowRunner : public QObject, public ModuleSource
+{
+    Q_OBJECT
+
+public:
+    WorkflowRunner(QObject *parent = nullptr);
+    ~WorkflowRunner();
+
+    // ModuleSource
+    void declareModules() override;
+    WorkflowModule *createModule(const std::string &group,
+                                 const std::string &name) override;
+
+    void loadPlugins();
+
+    bool openFile(const QString &path, int dataGroupIndex);
+    bool loadWorkflow(const QString &path);
+
+    const DataGroup *dataGroup() const;
+
+    // Both index the dimensions of the open data group. Display dimensions
+    // can't be changed.
+    bool setRange(int dimension, int start, int count);
+    bool setIterated(int dimension);
+
+    void setOutput(const QString &directory, const QString &fileStem);
+    void setOutputMode(BinaryOutputModule::OutputMode mode);
+    void setOutputType(DataType type);
+    void setScalingLimits(float min, float max);
+
+    bool start();
+
+private slots:
+    void countFrame(Frame *frame);
+    void workflowFinished();
+
+signals:
+    void finished();
+
+private:
+    QList<Plugin *> m_plugins;
+    Model *m_model;
+    DataGroup *m_dataGroup;
+    Workflow *m_workflow;
+    FrameSet::Selection m_selection;
+
+    QString m_outputDirectory;
+    QString m_fileStem;
+    BinaryOutputModule::OutputMode m_outputMode;
+    BinaryOutputModule::ProcessingMode m_processingMode;
+    DataType m_outputType;
+    float m_scalingMin;
+    float m_scalingMax;
+
+    BinaryExport *m_export;
+    BinaryOutputModule *m_outputModule;
+    ImageWindowModule *m_imageOutputModule;
+
+    QElapsedTimer m_timer;
+    int64_t m_frameCount;
+};
+
+} // namespace emd
+
+#endif
@@ -0,0 +1,391 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "WorkflowRunner.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLibrary>
+#include <QPluginLoader>
+#include <QTextStream>
+
+#include "BinaryExport.h"
+#include "ComplexModule.h"
+#include "DataGroup.h"
+#include "DataGroupModule.h"
+#include "Dataset.h"
+#include "DatasetStorage.h"
+#include "FileManager.h"
+#include "FrameCache.h"
+#include "HistogramModule.h"
+#include "ImageWindowModule.h"
+#include "Model.h"
+#include "Plugin.h"
+#include "WorkScheduler.h"
+#include "Workflow.h"
+
+namespace emd
+{
+
+WorkflowRunner::WorkflowRunner(QObject *parent)
+    : QObject(parent),
+    m_model(nullptr),
+    m_dataGroup(nullptr),
+    m_workflow(nullptr),
+    m_outputMode(BinaryOutputModule::OutputModeInvidual),
+    m_processingMode(BinaryOutputModule::ProcessingModeTruncate),
+    m_outputType(DataTypeFloat32),
+    m_scalingMin(0.f),
+    m_scalingMax(1.f),
+    m_export(nullptr),
+    m_outputModule(nullptr),
+    m_imageOutputModule(nullptr),
+    m_frameCount(0)
+{
+    declareModules();
+}
+
+WorkflowRunner::~WorkflowRunner()
+{
+    if(m_export)
+        delete m_export;
+
+    if(m_workflow)
+        delete m_workflow;
+
+    if(m_model)
+        delete m_model;
+}
+
+/******************************** Module Source **********************************/
+
+void WorkflowRunner::declareModules()
+{
+    WorkflowModule::declare("Core", "BinaryOutput", this,
+        "Converts data from one type to another.");
+
+    WorkflowModule::declare("Core", "Complex", this,
+        "Converts complex data to real data.");
+
+    WorkflowModule::declare("Core", "DataGroup", this,
+        "Retrieves input data from a data group.");
+
+    WorkflowModule::declare("Core", "Histogram", this,
+        "Displays a histogram plot of the data.");
+
+    WorkflowModule::declare("Core", "ImageWindow", this,
+        "");
+}
+
+WorkflowModule *WorkflowRunner::createModule(const std::string &group,
+                                             const std::string &name)
+{
+    if(group.compare("Core") == 0)
+    {
+        if(name.compare("BinaryOutput") == 0)
+        {
+            return new BinaryOutputModule();
+        }
+        else if(name.compare("Complex") == 0)
+        {
+            return new ComplexModule();
+        }
+        else if(name.compare("DataGroup") == 0)
+        {
+            return new DataGroupModule(nullptr);
+        }
+        else if(name.compare("Histogram") == 0)
+        {
+            return new HistogramModule();
+        }
+        else if(name.compare("ImageWindow") == 0)
+        {
+            return new ImageWindowModule();
+        }
+    }
+
+    return nullptr;
+}
+
+/******************************** Setup ***********************************/
+
+void WorkflowRunner::loadPlugins()
+{
+    // Same location as the viewer, so both share one plugin directory.
+    QDir pluginsDir = QDir(QCoreApplication::applicationDirPath());
+    if(!pluginsDir.cd("plugins"))
+    {
+        qDebug() << "Failed to locate plugin directory.";
+        return;
+    }
+
+    QStringList files = pluginsDir.entryList(QDir::Files);
+
+    for(const QString &fileName : files)
+    {
+        QString path = pluginsDir.absoluteFilePath(fileName);
+
+        if(!QLibrary::isLibrary(path))
+            continue;
+
+        QPluginLoader loader(path);
+        Plugin *plugin = qobject_cast<Plugin*>(loader.instance());
+
+        if(plugin)
+        {
+            m_plugins.append(plugin);
+
+            plugin->declareModules();
+        }
+        else
+        {
+            qWarning() << "Could not load plugin: " << fileName;
+        }
+    }
+}
+
+bool WorkflowRunner::openFile(const QString &path, int dataGroupIndex)
+{
+    Model *model = new Model();
+
+    FileManager::Error error = FileManager::openFile(path.toUtf8(), model);
+
+    if(error != FileManager::ErrorNone)
+    {
+        qCritical() << "Failed to open file: " << path;
+        delete model;
+        return false;
+    }
+
+    model->setFilePath(path);
+    model->validateDataGroups();
+
+    if(dataGroupIndex < 0 || dataGroupIndex >= model->dataGroupCount())
+    {
+        qCritical() << "Invalid data group index: " << dataGroupIndex;
+        delete model;
+        return false;
+    }
+
+    if(!model->loadDataGroup(dataGroupIndex))
+    {
+        qCritical() << "Failed to load data group at index: " << dataGroupIndex;
+        delete model;
+        return false;
+    }
+
+    m_model = model;
+    m_dataGroup = model->dataGroupAtIndex(dataGroupIndex);
+
+    DatasetStorage::attach(m_dataGroup);
+    FrameCache::instance().tuneChunkCache(m_dataGroup);
+    m_selection = FrameSet::Selection(m_dataGroup->data()->defaultSlice());
+
+    return true;
+}
+
+bool WorkflowRunner::loadWorkflow(const QString &path)
+{
+    Workflow *workflow = new Workflow(QFileInfo(path).baseName());
+
+    // Hold the workflow until the data and output are attached.
+    workflow->setPaused(true);
+
+    if(!workflow->load(path))
+    {
+        delete workflow;
+        return false;
+    }
+
+    m_workflow = workflow;
+
+    return true;
+}
+
+const DataGroup *WorkflowRunner::dataGroup() const
+{
+    return m_dataGroup;
+}
+
+bool WorkflowRunner::setRange(int dimension, int start, int count)
+{
+    if(!m_dataGroup || dimension < 0 || dimension >= (int) m_selection.size())
+        return false;
+
+    if(FrameSet::isDisplayRole(m_selection[dimension].role))
+        return false;
+
+    int length = m_dataGroup->dimData(dimension)->dimLength(0);
+
+    if(start < 0 || count < 1 || start + count > length)
+        return false;
+
+    m_selection[dimension].start = start;
+    m_selection[dimension].count = count;
+
+    return true;
+}
+
+bool WorkflowRunner::setIterated(int dimension)
+{
+    if(!m_dataGroup || dimension < 0 || dimension >= (int) m_selection.size())
+        return false;
+
+    if(FrameSet::isDisplayRole(m_selection[dimension].role))
+        return false;
+
+    m_selection[dimension].role = FrameSet::DimensionRole::Selection;
+
+    return true;
+}
+
+void WorkflowRunner::setOutput(const QString &directory, const QString &fileStem)
+{
+    m_outputDirectory = directory;
+    m_fileStem = fileStem;
+}
+
+void WorkflowRunner::setOutputMode(BinaryOutputModule::OutputMode mode)
+{
+    m_outputMode = mode;
+}
+
+void WorkflowRunner::setOutputType(DataType type)
+{
+    m_outputType = type;
+}
+
+void WorkflowRunner::setScalingLimits(float min, float max)
+{
+    m_processingMode = BinaryOutputModule::ProcessingModeScale;
+    m_scalingMin = min;
+    m_scalingMax = max;
+}
+
+/******************************** Processing ***********************************/
+
+bool WorkflowRunner::start()
+{
+    if(!m_workflow || !m_dataGroup)
+        return false;
+
+    // Wire the workflow the way CentralWidget does for an export.
+    const QList<WorkflowModule *> &modules = m_workflow->modules();
+    for(WorkflowModule *module : modules)
+    {
+        if(module->instanceId() == DataGroupModule::classId())
+        {
+            DataGroupModule *dg = dynamic_cast<DataGroupModule*>(module);
+
+            if(dg->property("Source").toString().compare("Automatic") == 0)
+            {
+                QVariant var;
+                var.setValue(const_cast<const DataGroup *>(m_dataGroup));
+                dg->setProperty("DataGroup", var);
+                dg->setSelection(m_selection);
+            }
+        }
+        else if(module->instanceId() == ImageWindowModule::classId())
+        {
+            ImageWindowModule *iw = dynamic_cast<ImageWindowModule*>(module);
+
+            if(iw->property("Output").toString().compare("MainWindow") == 0)
+                m_imageOutputModule = iw;
+        }
+        else if(module->instanceId() == HistogramModule::classId())
+        {
+            module->setActive(false);
+        }
+    }
+
+    if(!m_imageOutputModule)
+    {
+        qCritical() << "Workflow has no main image output: " << m_workflow->name();
+        return false;
+    }
+
+    m_outputModule = new BinaryOutputModule();
+    m_outputModule->setOutputMode(m_outputMode);
+    m_outputModule->setProcessingMode(m_processingMode);
+    m_outputModule->setOutputType(m_outputType);
+
+    if(m_processingMode == BinaryOutputModule::ProcessingModeScale)
+        m_outputModule->setScalingLimits(QVariant(m_scalingMin), QVariant(m_scalingMax));
+
+    m_export = new BinaryExport();
+    m_export->setOutputModule(m_outputModule);
+    m_export->setOutputDirectory(m_outputDirectory);
+    m_export->setFileStem(m_fileStem);
+    m_export->setFileSuffix(".dat");
+    m_export->setItemCount(m_selection.count());
+
+    connect(m_outputModule, SIGNAL(frameProcessed(Frame *)),
+        this, SLOT(countFrame(Frame *)));
+
+    m_imageOutputModule->setActive(false);
+    m_imageOutputModule->addOutput(m_outputModule);
+    m_outputModule->addInput(m_imageOutputModule);
+    m_workflow->addModule(m_outputModule);
+
+    connect(m_workflow, SIGNAL(finishedProcessing()),
+        this, SLOT(workflowFinished()));
+
+    m_frameCount = 0;
+    m_timer.start();
+
+    m_workflow->setPaused(false);
+
+    return true;
+}
+
+/******************************** Slots ***********************************/
+
+void WorkflowRunner::countFrame(Frame *)
+{
+    ++m_frameCount;
+}
+
+void WorkflowRunner::workflowFinished()
+{
+    if(!m_export)
+        return;
+
+    double seconds = m_timer.nsecsElapsed() * 1e-9;
+
+    m_workflow->removeModule(m_outputModule);
+
+    m_export->finish();
+
+    delete m_export;
+    m_export = nullptr;
+    m_outputModule = nullptr;
+
+    QTextStream out(stdout);
+    out << m_frameCount << " frames in " << QString::number(seconds, 'f', 3) << " s ("
+        << QString::number(seconds > 0. ? m_frameCount / seconds : 0., 'f', 1)
+        << " frames/s, " << WorkScheduler::instance().threadCount() << " threads)\n";
+    out.flush();
+
+    emit(finished());
+}
+
+} // namespace emd
@@ -0,0 +1,205 @@
+/*
+ * emdViewer, a program for working with electron microscopy dataset 
+ * (emd) files.
+ * Copyright (C) 2015  Phil Ophus
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDebug>
+#include <QFileInfo>
+
+#include "DataGroup.h"
+#include "Util.h"
+#include "WorkScheduler.h"
+#include "WorkflowRunner.h"
+
+static const QString kProgramName = "emdrun";
+static const QString kCompanyName = "MesoBine";
+
+static const int s_supportedTypeCount = 10;
+static const emd::DataType s_types[s_supportedTypeCount] =
+{
+    emd::DataTypeUInt8,
+    emd::DataTypeUInt16,
+    emd::DataTypeUInt32,
+    emd::DataTypeUInt64,
+    emd::DataTypeInt8,
+    emd::DataTypeInt16,
+    emd::DataTypeInt32,
+    emd::DataTypeInt64,
+    emd::DataTypeFloat32,
+    emd::DataTypeFloat64
+};
+
+// Parses "<dim>=<start>:<count>".
+static bool parseRange(const QString &text, int &dimension, int &start, int &count)
+{
+    QStringList parts = text.split('=');
+    if(parts.count() != 2)
+        return false;
+
+    QStringList range = parts[1].split(':');
+    if(range.count() != 2)
+        return false;
+
+    bool ok[3];
+    dimension = parts[0].toInt(&ok[0]);
+    start = range[0].toInt(&ok[1]);
+    count = range[1].toInt(&ok[2]);
+
+    return ok[0] && ok[1] && ok[2];
+}
+
+static bool parseType(const QString &text, emd::DataType &type)
+{
+    for(int iii = 0; iii < s_supportedTypeCount; ++iii)
+    {
+        if(text.compare(emd::emdTypeString(s_types[iii]), Qt::CaseInsensitive) == 0)
+        {
+            type = s_types[iii];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    // Modules still use QImage and friends, so run a GUI application on the
+    // offscreen platform unless told otherwise. No display is needed.
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QCoreApplication::setOrganizationName(kCompanyName);
+    QCoreApplication::setApplicationName(kProgramName);
+
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs a workflow over a data group and writes the "
+        "frames reaching its main image output as binary data.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("workflow", "Workflow file (.xml).");
+    parser.addPositionalArgument("file", "Data file.");
+
+    QCommandLineOption groupOption(QStringList() << "g" << "group",
+        "Index of the data group to process.", "index", "0");
+    QCommandLineOption rangeOption(QStringList() << "r" << "range",
+        "Frame range of a non-display dimension. May be repeated.", "dim=start:count");
+    QCommandLineOption iterateOption(QStringList() << "i" << "iterate",
+        "Run the workflow once per index of a dimension. May be repeated.", "dim");
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+        "Output directory.", "dir", ".");
+    QCommandLineOption nameOption(QStringList() << "n" << "name",
+        "Output file name stem.", "stem");
+    QCommandLineOption typeOption(QStringList() << "t" << "type",
+        "Output data type.", "type", "float32");
+    QCommandLineOption scaleOption(QStringList() << "s" << "scale",
+        "Scale values into the given limits instead of truncating.", "min:max");
+    QCommandLineOption combinedOption(QStringList() << "c" << "combined",
+        "Write all frames to a single file.");
+    QCommandLineOption threadsOption(QStringList() << "j" << "threads",
+        "Number of worker threads. Defaults to all cores.", "count");
+
+    parser.addOption(groupOption);
+    parser.addOption(rangeOption);
+    parser.addOption(iterateOption);
+    parser.addOption(outputOption);
+    parser.addOption(nameOption);
+    parser.addOption(typeOption);
+    parser.addOption(scaleOption);
+    parser.addOption(combinedOption);
+    parser.addOption(threadsOption);
+
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if(args.count() != 2)
+        parser.showHelp(1);
+
+    // Use the whole machine rather than the viewer's preference.
+    int threadCount = parser.value(threadsOption).toInt();
+    if(threadCount <= 0)
+        threadCount = emd::WorkScheduler::environmentThreadCount();
+    emd::WorkScheduler::instance().setThreadCount(threadCount);
+
+    emd::WorkflowRunner runner;
+    runner.loadPlugins();
+
+    if(!runner.openFile(args[1], parser.value(groupOption).toInt()))
+        return 1;
+
+    for(const QString &range : parser.values(rangeOption))
+    {
+        int dimension, start, count;
+        if(!parseRange(range, dimension, start, count)
+           || !runner.setRange(dimension, start, count))
+        {
+            qCritical() << "Invalid range: " << range;
+            return 1;
+        }
+    }
+
+    for(const QString &dimension : parser.values(iterateOption))
+    {
+        if(!runner.setIterated(dimension.toInt()))
+        {
+            qCritical() << "Invalid dimension: " << dimension;
+            return 1;
+        }
+    }
+
+    emd::DataType type;
+    if(!parseType(parser.value(typeOption), type))
+    {
+        qCritical() << "Unknown data type: " << parser.value(typeOption);
+        return 1;
+    }
+    runner.setOutputType(type);
+
+    if(parser.isSet(scaleOption))
+    {
+        QStringList limits = parser.value(scaleOption).split(':');
+        if(limits.count() != 2)
+        {
+            qCritical() << "Invalid scaling limits: " << parser.value(scaleOption);
+            return 1;
+        }
+        runner.setScalingLimits(limits[0].toFloat(), limits[1].toFloat());
+    }
+
+    if(parser.isSet(combinedOption))
+        runner.setOutputMode(emd::BinaryOutputModule::OutputModeGrouped);
+
+    QString stem = parser.value(nameOption);
+    if(stem.isEmpty())
+        stem = QFileInfo(args[1]).completeBaseName() + "-" + runner.dataGroup()->name();
+    runner.setOutput(parser.value(outputOption), stem);
+
+    if(!runner.loadWorkflow(args[0]))
+        return 1;
+
+    QObject::connect(&runner, SIGNAL(finished()),
+        &app, SLOT(quit()));
+
+    if(!runner.start())
+        return 1;
+
+    return app.exec();
+}
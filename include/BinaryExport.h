@@ -22,6 +22,8 @@
 
 #include "ExportOperation.h"
 
+#include <QFile>
+
 #include "BinaryOutputModule.h"
 #include "Util.h"
 
@@ -46,8 +48,8 @@ private slots:
 
 private:
     BinaryOutputModule *m_outputModule;
-    void *m_exportData;
-    int64_t m_exportDataLength;
+    // Grouped exports are written as the frames arrive
+    QFile m_exportFile;
 };
 
 } // namespace emd
@@ -41,6 +41,7 @@ class DataGroup;
 class DataGroupModule;
 class DimensionsPane;
 class ExportOperation;
+class FramePrefetcher;
 class HistogramModule;
 class ImageWindowModule;
 class MainImageWidget;
@@ -106,6 +107,7 @@ private:
     Workflow *m_workflow;
     ImageWindowModule *m_imageOutputModule;
     HistogramModule *m_histogramModule;
+    FramePrefetcher *m_prefetcher;
     BinaryOutputModule *m_binaryOutputModule;
     
     QVBoxLayout *m_workflowLayout;
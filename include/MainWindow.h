@@ -90,6 +90,7 @@ private slots:
     void expandMessageLog();
     void setMessageLogExpanded(bool expanded);
     void displayTempMessage(const QString &msg);
+    void updateCacheStatus();
 
 	// Docks
 	void changeWorkflowControlVisibility(bool);
@@ -122,6 +123,7 @@ private slots:
     void printCurrentWorkflow() const;
 	void printWorkflow(Workflow *workflow) const;
     void printModels() const;
+    void saveTrace();
 
 private:
 	QSettings m_settings;
@@ -161,6 +163,7 @@ private:
     QTimer *m_messageLogTimer;
 	LogView *m_messageView;
     QLabel *m_tempStatusLabel;
+    QLabel *m_cacheStatusLabel;
 
 	// Data
     ModelManager m_modelManager;
@@ -24,6 +24,7 @@
 
 class QComboBox;
 class QLabel;
+class QSpinBox;
 
 namespace emd
 {
@@ -47,6 +48,9 @@ private slots:
 private:
     QLabel *m_colourMapLabel;
     QComboBox *m_colourMapBox;
+    QSpinBox *m_threadCountBox;
+    QSpinBox *m_cacheSizeBox;
+    QSpinBox *m_streamingLimitBox;
 };
 
 } // namespace emd
@@ -43,12 +43,24 @@ public:
 	
 	// Inherited from WorkflowModule
 	virtual QWidget *controlWidget();
+    virtual ConcurrencyMode concurrencyMode() const;
+    virtual FrameLayout inputLayout() const;
+    virtual void preprocess();
 	virtual Frame *processFrame(Frame *frame, int index);
 
 private:
+	template <typename> friend struct ProcessDataKernel;
+
 	template <typename T>
 	Frame *processData(Frame *frame);
 
+    // Read from the properties by preprocess(), for the workers. Only
+    // written before the run's work is queued, which orders the writes
+    // before the workers' reads. A change while a run is going takes effect
+    // on the next run; setting the property supersedes the current one.
+    TransformType m_transformType;
+    bool m_dataShift;
+
 public slots:
 	void setTransformType(int type);
 };
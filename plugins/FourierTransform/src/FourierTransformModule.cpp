@@ -30,6 +30,7 @@
 #include <QPushButton>
 #include <QVBoxLayout>
 
+#include "DataTypeDispatch.h"
 #include "Frame.h"
 
 namespace emd
@@ -38,6 +39,8 @@ namespace emd
 EMD_MODULE_DEFINITION(FourierTransformModule)
 
 FourierTransformModule::FourierTransformModule()
+    : m_transformType(TransformTypeNone),
+    m_dataShift(false)
 {
     setProperty("TransformType", "None");
     setProperty("DataShift", "false");
@@ -91,35 +94,64 @@ QWidget *FourierTransformModule::controlWidget()
     return controlWidget;
 }
 
+WorkflowModule::ConcurrencyMode FourierTransformModule::concurrencyMode() const
+{
+    return ConcurrencyParallel;
+}
+
+WorkflowModule::FrameLayout FourierTransformModule::inputLayout() const
+{
+    return LayoutRowMajor;
+}
+
+void FourierTransformModule::preprocess()
+{
+    // Properties are only read on the GUI thread
+    QString transformType = property("TransformType").toString();
+
+    if(transformType.compare("Forward") == 0)
+        m_transformType = TransformTypeForward;
+    else if(transformType.compare("Reverse") == 0)
+        m_transformType = TransformTypeReverse;
+    else
+        m_transformType = TransformTypeNone;
+
+    m_dataShift = property("DataShift").toBool();
+}
+
 Frame *FourierTransformModule::processFrame(Frame *frame, int /*index*/)
 {
-	switch(frame->dataType())
-	{
-	case DataTypeInt8:
-		return processData<int8_t>(frame);
-	case DataTypeInt16:
-		return processData<int16_t>(frame);
-	case DataTypeInt32:
-		return processData<int32_t>(frame);
-	case DataTypeInt64:
-		return processData<int64_t>(frame);
-	case DataTypeUInt8:
-		return processData<uint8_t>(frame);
-	case DataTypeUInt16:
-		return processData<uint16_t>(frame);
-	case DataTypeUInt32:
-		return processData<uint32_t>(frame);
-	case DataTypeUInt64:
-		return processData<uint64_t>(frame);
-	case DataTypeFloat32:
-		return processData<float>(frame);
-	case DataTypeFloat64:
-		return processData<double>(frame);
-	default:
-		break;
-	}
+	return dispatchDataType<ProcessDataKernel>(frame->dataType(), this, frame);
+}
 
-    return NULL;
+// Packs a row-major frame into kiss_fft's interleaved complex layout
+template <typename T>
+static void packComplex(const Frame::Data<T> &data, kiss_fft_cpx *output)
+{
+    for(int jjj = 0; jjj < data.vSize; ++jjj)
+    {
+        const T *real = data.real + jjj * data.vStep;
+        kiss_fft_cpx *line = output + jjj * data.hSize;
+
+        if(data.imaginary)
+        {
+            const T *imaginary = data.imaginary + jjj * data.vStep;
+
+            for(int iii = 0; iii < data.hSize; ++iii)
+            {
+                line[iii].r = (float) real[iii];
+                line[iii].i = (float) imaginary[iii];
+            }
+        }
+        else
+        {
+            for(int iii = 0; iii < data.hSize; ++iii)
+            {
+                line[iii].r = (float) real[iii];
+                line[iii].i = 0.f;
+            }
+        }
+    }
 }
 
 template <typename T>
@@ -129,66 +161,32 @@ Frame *FourierTransformModule::processData(Frame *frame)
 	Frame::Data<float> oData(iData.attributes,
                                 1, iData.hSize,
                                 iData.hSize, iData.vSize,
-                                new float[iData.size()], 
-                                new float[iData.size()]);
+                                (float *) allocateBuffer((int64_t) iData.size() * sizeof(float)),
+                                (float *) allocateBuffer((int64_t) iData.size() * sizeof(float)));
+
+    int64_t scratchBytes = (int64_t) iData.hSize * iData.vSize * sizeof(kiss_fft_cpx);
 
-    if(property("TransformType").toString().compare("Forward") == 0)
+    if(m_transformType == TransformTypeForward)
 	{
-		if(property("DataShift").toBool())
+		if(m_dataShift)
 			oData.setAttribute(Frame::AttributeFourierTransformed);
 		else
 			oData.setAttribute(Frame::AttributeFourierTransformedNoShift);
 
-		int inputPos = 0, outputPos = 0;
-		int inputOffset = 0, outputOffset = 0;
+		kiss_fft_cpx* freqData = (kiss_fft_cpx *) allocateBuffer(scratchBytes);
+		kiss_fft_cpx* timeData = (kiss_fft_cpx *) allocateBuffer(scratchBytes);
 
-		kiss_fft_cpx* freqData = new kiss_fft_cpx[iData.hSize * iData.vSize];
-		kiss_fft_cpx* timeData = new kiss_fft_cpx[iData.hSize * iData.vSize];
+		packComplex(iData, timeData);
 
-        // TODO: better way?
-        if(iData.imaginary)
-        {
-		    for(int iii = 0; iii < iData.hSize; ++iii)
-		    {
-			    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			    {
-				    timeData[outputPos].r = (float) iData.real[inputPos];
-				    timeData[outputPos].i = (float) iData.imaginary[inputPos];
-				    inputPos += iData.vStep;
-				    outputPos += oData.vStep;
-			    }
-			    inputOffset += iData.hStep;
-			    outputOffset += oData.hStep;
-			    inputPos = inputOffset;
-			    outputPos = outputOffset;
-		    }
-        }
-        else
-        {
-            for(int iii = 0; iii < iData.hSize; ++iii)
-		    {
-			    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			    {
-				    timeData[outputPos].r = (float) iData.real[inputPos];
-				    timeData[outputPos].i = 0.f;
-				    inputPos += iData.vStep;
-				    outputPos += oData.vStep;
-			    }
-			    inputOffset += iData.hStep;
-			    outputOffset += oData.hStep;
-			    inputPos = inputOffset;
-			    outputPos = outputOffset;
-		    }
-        }
-
-		int* dims = new int[2];
+		int dims[2];
 		dims[1] = iData.hSize;
 		dims[0] = iData.vSize;
 		kiss_fftnd_cfg cfg = kiss_fftnd_alloc(dims, 2, 0, NULL, NULL);
 
 		kiss_fftnd(cfg, timeData, freqData);
+		kiss_fft_free(cfg);
 
-		if(property("DataShift").toBool())
+		if(m_dataShift)
 		{
 			int k = 0;
 			int vHalf = oData.vSize / 2;
@@ -233,66 +231,30 @@ Frame *FourierTransformModule::processData(Frame *frame)
 			}
 		}
 
-		delete[] freqData;
-		delete[] timeData;
-		delete[] dims;
+		releaseBuffer(freqData);
+		releaseBuffer(timeData);
 	}
-	else if(property("TransformType").toString().compare("Reverse") == 0)
+	else if(m_transformType == TransformTypeReverse)
 	{
 		oData.unsetAttribute(Frame::AttributeFourierTransformed);
 		oData.unsetAttribute(Frame::AttributeFourierTransformedNoShift);
 
-		int inputPos = 0, outputPos = 0;
-		int inputOffset = 0, outputOffset = 0;
+		kiss_fft_cpx* freqData = (kiss_fft_cpx *) allocateBuffer(scratchBytes);
+		kiss_fft_cpx* timeData = (kiss_fft_cpx *) allocateBuffer(scratchBytes);
 
-		kiss_fft_cpx* freqData = new kiss_fft_cpx[iData.hSize * iData.vSize];
-		kiss_fft_cpx* timeData = new kiss_fft_cpx[iData.hSize * iData.vSize];
-
-        if(iData.imaginary)
-        {
-		    for(int iii = 0; iii < iData.hSize; ++iii)
-		    {
-			    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			    {
-				    freqData[outputPos].r = (float) iData.real[inputPos];
-				    freqData[outputPos].i = (float) iData.imaginary[inputPos];
-				    inputPos += iData.vStep;
-				    outputPos += oData.vStep;
-			    }
-			    inputOffset += iData.hStep;
-			    outputOffset += oData.hStep;
-			    inputPos = inputOffset;
-			    outputPos = outputOffset;
-		    }
-        }
-        else
-        {
-            for(int iii = 0; iii < iData.hSize; ++iii)
-		    {
-			    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-			    {
-				    freqData[outputPos].r = (float) iData.real[inputPos];
-				    freqData[outputPos].i = 0.f;
-				    inputPos += iData.vStep;
-				    outputPos += oData.vStep;
-			    }
-			    inputOffset += iData.hStep;
-			    outputOffset += oData.hStep;
-			    inputPos = inputOffset;
-			    outputPos = outputOffset;
-		    }
-        }
+		packComplex(iData, freqData);
 
-		int* dims = new int[2];
+		int dims[2];
 		dims[1] = iData.hSize;
 		dims[0] = iData.vSize;
 		kiss_fftnd_cfg cfg = kiss_fftnd_alloc(dims, 2, 1, NULL, NULL);
 
 		kiss_fftnd(cfg, freqData, timeData);
+		kiss_fft_free(cfg);
 
 		float magnitudeCorrection = 1.f / (oData.hSize * oData.vSize);
 
-		if(property("DataShift").toBool())
+		if(m_dataShift)
 		{
 			int k = 0;
 			int vHalf = oData.vSize / 2;
@@ -335,9 +297,8 @@ Frame *FourierTransformModule::processData(Frame *frame)
 			}
 		}
 
-		delete[] freqData;
-		delete[] timeData;
-		delete[] dims;
+		releaseBuffer(freqData);
+		releaseBuffer(timeData);
 	}
 	//else if(m_shift)
 	//{
@@ -399,18 +360,20 @@ Frame *FourierTransformModule::processData(Frame *frame)
 	//}
     else
     {
-        // Just copy the data
-        delete[] oData.real;
-        delete[] oData.imaginary;
+        // Pass the frame on unchanged
+        releaseBuffer(oData.real);
+        releaseBuffer(oData.imaginary);
 
-        return new Frame(iData, DataTypeFloat32, false);
+        return frame;
     }
 
-    return new Frame(Frame::Data<void>(oData), emd::DataTypeFloat32);
+    return createFrame(Frame::Data<void>(oData), emd::DataTypeFloat32);
 }
 
 /************************ Slots ****************************/
 
+// Setting the property updates the module, which cancels the current run
+// and queues another one with the new type
 void FourierTransformModule::setTransformType(int type)
 {
     switch (type)
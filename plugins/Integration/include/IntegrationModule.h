@@ -23,6 +23,9 @@
 
 #include "WorkflowModule.h"
 
+#include <memory>
+#include <vector>
+
 #include <qlist.h>
 #include <qmap.h>
 
@@ -47,6 +50,10 @@ public:
     void doPropertyChanged(const QString &key) override;
     void reset();
     RequiredFeatures requiredFeatures() const override;
+    ConcurrencyMode concurrencyMode() const override;
+    InputMode inputMode() const override;
+    FrameLayout inputLayout() const override;
+    bool cancellable() const override;
 	void preprocess() override;
 	emd::Frame *processFrame(emd::Frame *frame, int index) override;
     void postprocess() override;
@@ -57,7 +64,26 @@ private:
 	template <typename T>
 	void subtractFrame(emd::Frame *frame);
 
+    template <typename T>
+    struct AddKernel
+    {
+        static void run(IntegrationModule *module, emd::Frame *frame)
+        {
+            module->addFrame<T>(frame);
+        }
+    };
+
+    template <typename T>
+    struct SubtractKernel
+    {
+        static void run(IntegrationModule *module, emd::Frame *frame)
+        {
+            module->subtractFrame<T>(frame);
+        }
+    };
+
     void addDimensionButtons();
+    void clearResultFrame();
 
 public slots:
     void setSelectionDimensions(int) override;
@@ -66,11 +92,12 @@ private slots:
     void dimensionClicked(int);
 
 private:
-    emd::Frame *m_resultFrame;
+    std::shared_ptr<emd::Frame> m_resultFrame;
     int m_integratedFrameCount;
     emd::ProcessingContext m_lastInputContext;
-    emd::ProcessingContext m_subtractionContext;
     int m_cutoffInputIndex;
+    // Set while the input is a window of a streamed selection
+    bool m_streamed;
 
     int m_selectionDims;
     int m_availableDims;
@@ -27,14 +27,16 @@
 #include <qradiobutton.h>
 #include <QVBoxLayout>
 
-#include "Frame.h"
 #include "DataGroup.h"
+#include "DataTypeDispatch.h"
+#include "Frame.h"
+#include "PixelKernels.h"
 
 EMD_MODULE_DEFINITION(IntegrationModule)
 
 IntegrationModule::IntegrationModule()
-    : m_resultFrame(nullptr),
-    m_integratedFrameCount(0),
+    : m_integratedFrameCount(0),
+    m_streamed(false),
     m_dimensionLayout(nullptr),
     m_dimensionGroup(nullptr),
     m_selectionDims(0)
@@ -135,11 +137,13 @@ void IntegrationModule::reset()
 
     m_lastInputContext.reset();
 
-    if(m_resultFrame)
-    {
-        delete m_resultFrame;
-        m_resultFrame = NULL;
-    }
+    clearResultFrame();
+}
+
+void IntegrationModule::clearResultFrame()
+{
+    // Outputs still showing the result keep their reference
+    m_resultFrame.reset();
 
     m_integratedFrameCount = 0;
 }
@@ -149,45 +153,73 @@ emd::WorkflowModule::RequiredFeatures IntegrationModule::requiredFeatures() cons
     return RangeSelectionFeature;
 }
 
+emd::WorkflowModule::ConcurrencyMode IntegrationModule::concurrencyMode() const
+{
+    // Every frame is accumulated into the same result frame.
+    return ConcurrencySerial;
+}
+
+emd::WorkflowModule::FrameLayout IntegrationModule::inputLayout() const
+{
+    return LayoutRowMajor;
+}
+
+emd::WorkflowModule::InputMode IntegrationModule::inputMode() const
+{
+    // preprocess() diffs the complete input set against the last one.
+    return InputBarrier;
+}
+
+bool IntegrationModule::cancellable() const
+{
+    // The result frame would be left with only part of a run added.
+    return false;
+}
+
 void IntegrationModule::preprocess()
 {
-    emd::FrameList framesToAdd;
-    emd::FrameList framesToSubtract;
+    std::vector<std::shared_ptr<emd::Frame>> framesToAdd;
+    std::vector<std::shared_ptr<emd::Frame>> framesToSubtract;
+
+    emd::FrameSet *frameSet = m_inputContext.frameSet();
+    m_streamed = (frameSet && frameSet->windowCount() > 1);
 
-    if(m_lastInputContext.isValid())
+    if(m_streamed)
+    {
+        // The windows of a streamed selection are disjoint, so each one is
+        // simply added. The last window isn't kept for diffing, as it would
+        // hold on to a window's worth of frames.
+        if(frameSet->windowIndex() == 0)
+            clearResultFrame();
+
+        m_lastInputContext.reset();
+
+        m_cutoffInputIndex = (int) m_inputContext.frameCount();
+    }
+    else if(m_lastInputContext.isValid())
     {
         m_inputContext.frameSet()->subtract(*m_lastInputContext.frameSet(), framesToAdd);
 
         m_lastInputContext.frameSet()->subtract(*m_inputContext.frameSet(), framesToSubtract);
-        
-        if(framesToSubtract.size() > 0)
-        {
-            // If we're subtracting frames, preserve the context which contains
-            // them so that they live long enough for the work to be done.
-            m_subtractionContext = m_lastInputContext;
-        }
     
         m_lastInputContext = m_inputContext;
 
+        // The new input context shares the frames, so the ones being
+        // subtracted live until the run is done with them.
         m_inputContext.reset();
         m_inputContext.init((int)(framesToAdd.size() + framesToSubtract.size()));
 
-        // Copy the frames before setting them in the new input context.
-        // This avoids having the same frames referenced by two different
-        // processing contexts which would both try to delete them.
-        // The copied frames don't own the data, so the frame data are
-        // not deleted until m_lastInputContext is reset.
         int index = 0;
         while(index < framesToAdd.size())
         {
-            m_inputContext.setFrameAtIndex(new emd::Frame(framesToAdd.at(index)), index);
+            m_inputContext.setSharedFrameAtIndex(framesToAdd.at(index), index);
 
             ++index;
         }
 
         while(index < m_inputContext.frameCount())
         {
-            m_inputContext.setFrameAtIndex(new emd::Frame(framesToSubtract.at(index - framesToAdd.size())), index);
+            m_inputContext.setSharedFrameAtIndex(framesToSubtract.at(index - framesToAdd.size()), index);
 
             ++index;
         }
@@ -196,6 +228,9 @@ void IntegrationModule::preprocess()
     }
     else
     {
+        // A streamed result can't be diffed against; start over
+        clearResultFrame();
+
         m_cutoffInputIndex = (int) m_inputContext.frameCount();
         
         m_lastInputContext = m_inputContext;
@@ -217,7 +252,7 @@ void IntegrationModule::preprocess()
             memset(imag, 0, 4 * size);
         }
 
-        m_resultFrame = new emd::Frame(real, imag, 1, data.hSize, data.hSize, data.vSize, emd::DataTypeFloat32);
+        m_resultFrame.reset(new emd::Frame(real, imag, 1, data.hSize, data.hSize, data.vSize, emd::DataTypeFloat32));
 
         m_resultFrame->setIndex(0);
     }
@@ -226,90 +261,16 @@ void IntegrationModule::preprocess()
 emd::Frame *IntegrationModule::processFrame(emd::Frame *frame, int index)
 {
     if(index < m_cutoffInputIndex)
-    {
-	    switch(frame->dataType())
-	    {
-	    case emd::DataTypeInt8:
-		    addFrame<int8_t>(frame);
-		    break;
-	    case emd::DataTypeInt16:
-		    addFrame<int16_t>(frame);
-		    break;
-	    case emd::DataTypeInt32:
-		    addFrame<int32_t>(frame);
-		    break;
-	    case emd::DataTypeInt64:
-		    addFrame<int64_t>(frame);
-		    break;
-	    case emd::DataTypeUInt8:
-		    addFrame<uint8_t>(frame);
-		    break;
-	    case emd::DataTypeUInt16:
-		    addFrame<uint16_t>(frame);
-		    break;
-	    case emd::DataTypeUInt32:
-		    addFrame<uint32_t>(frame);
-		    break;
-	    case emd::DataTypeUInt64:
-		    addFrame<uint64_t>(frame);
-		    break;
-	    case emd::DataTypeFloat32:
-		    addFrame<float>(frame);
-		    break;
-	    case emd::DataTypeFloat64:
-		    addFrame<double>(frame);
-		    break;
-	    default:
-		    break;
-	    }
-    }
+        emd::dispatchDataType<AddKernel>(frame->dataType(), this, frame);
     else
-    {
-        switch(frame->dataType())
-	    {
-	    case emd::DataTypeInt8:
-		    subtractFrame<int8_t>(frame);
-		    break;
-	    case emd::DataTypeInt16:
-		    subtractFrame<int16_t>(frame);
-		    break;
-	    case emd::DataTypeInt32:
-		    subtractFrame<int32_t>(frame);
-		    break;
-	    case emd::DataTypeInt64:
-		    subtractFrame<int64_t>(frame);
-		    break;
-	    case emd::DataTypeUInt8:
-		    subtractFrame<uint8_t>(frame);
-		    break;
-	    case emd::DataTypeUInt16:
-		    subtractFrame<uint16_t>(frame);
-		    break;
-	    case emd::DataTypeUInt32:
-		    subtractFrame<uint32_t>(frame);
-		    break;
-	    case emd::DataTypeUInt64:
-		    subtractFrame<uint64_t>(frame);
-		    break;
-	    case emd::DataTypeFloat32:
-		    subtractFrame<float>(frame);
-		    break;
-	    case emd::DataTypeFloat64:
-		    subtractFrame<double>(frame);
-		    break;
-	    default:
-		    break;
-	    }
-    }
+        emd::dispatchDataType<SubtractKernel>(frame->dataType(), this, frame);
 
     return NULL;
 }
 
 void IntegrationModule::postprocess()
 {
-    m_subtractionContext.reset();
-
-    if(m_lastInputContext.frameCount() != m_integratedFrameCount)
+    if(!m_streamed && m_lastInputContext.frameCount() != m_integratedFrameCount)
     {
         qCritical() << "Integrated frame vector size mismatch!";
         return;
@@ -319,75 +280,34 @@ void IntegrationModule::postprocess()
 
     m_outputContext.init(1);
 
-    m_outputContext.setFrameAtIndex(new emd::Frame(m_resultFrame), 0);
+    m_outputContext.setSharedFrameAtIndex(m_resultFrame, 0);
 }
 
 template <typename T>
 void IntegrationModule::addFrame(emd::Frame *frame)
 {
     emd::Frame::Data<T> iData = frame->data<T>();
-	emd::Frame::Data<T> oData(iData.attributes,
-                                1, iData.hSize,
-                                iData.hSize, iData.vSize,
-                                new T[iData.size()], 
-                                iData.imaginary ? new T[iData.size()] : NULL);
 
     emd::Frame::Data<float> rData = m_resultFrame->data<float>();
-    
-	int inputPos = 0, outputPos = 0;
-	int inputOffset = 0, outputOffset = 0;
 
-    if(frame->isComplex())
-    {
-	    for(int iii = 0; iii < iData.hSize; ++iii)
-	    {
-		    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-		    {
-                rData.real[outputPos] = (float)(((double)m_integratedFrameCount * rData.real[outputPos] 
-                                         + iData.real[inputPos])
-                                             / (m_integratedFrameCount + 1));
-
-                rData.imaginary[outputPos] = (float)(((double)m_integratedFrameCount * rData.imaginary[outputPos] 
-                                         + iData.imaginary[inputPos])
-                                             / (m_integratedFrameCount + 1));
-
-			    oData.real[outputPos] = iData.real[inputPos];
-                oData.imaginary[outputPos] = iData.imaginary[inputPos];
-
-			    inputPos += iData.vStep;
-			    outputPos += oData.vStep;
-		    }
-
-		    inputOffset += iData.hStep;
-		    outputOffset += oData.hStep;
-
-		    inputPos = inputOffset;
-		    outputPos = outputOffset;
-	    }
-    }
-    else
-    {
-        for(int iii = 0; iii < iData.hSize; ++iii)
-	    {
-		    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-		    {
-                rData.real[outputPos] = (float)(((double)m_integratedFrameCount * rData.real[outputPos] 
-                                         + iData.real[inputPos])
-                                             / (m_integratedFrameCount + 1));
-
-			    oData.real[outputPos] = iData.real[inputPos];
-
-			    inputPos += iData.vStep;
-			    outputPos += oData.vStep;
-		    }
-
-		    inputOffset += iData.hStep;
-		    outputOffset += oData.hStep;
-
-		    inputPos = inputOffset;
-		    outputPos = outputOffset;
-	    }
-    }
+    // Both frames are row-major (see inputLayout()), so the rows run at unit
+    // stride. The mean of n frames becomes (n * mean + input) / (n + 1).
+    double scale = 1. / (m_integratedFrameCount + 1);
+    double keep = m_integratedFrameCount * scale;
+
+	for(int jjj = 0; jjj < iData.vSize; ++jjj)
+	{
+        emd::AccumulateKernel<T>::run(iData.real + jjj * iData.vStep,
+                                      rData.real + jjj * rData.vStep,
+                                      iData.hSize, keep, scale);
+
+        if(frame->isComplex())
+        {
+            emd::AccumulateKernel<T>::run(iData.imaginary + jjj * iData.vStep,
+                                          rData.imaginary + jjj * rData.vStep,
+                                          iData.hSize, keep, scale);
+        }
+	}
 
     ++m_integratedFrameCount;
 }
@@ -399,55 +319,23 @@ void IntegrationModule::subtractFrame(emd::Frame *frame)
     
     emd::Frame::Data<float> rData = m_resultFrame->data<float>();
 
-	int inputPos = 0, outputPos = 0;
-	int inputOffset = 0, outputOffset = 0;
+    // The mean of n frames becomes (n * mean - input) / (n - 1)
+    double scale = 1. / (m_integratedFrameCount - 1);
+    double keep = m_integratedFrameCount * scale;
 
-    if(frame->isComplex())
-    {
-	    for(int iii = 0; iii < iData.hSize; ++iii)
-	    {
-		    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-		    {
-                rData.real[outputPos] = (float)(((double)m_integratedFrameCount * rData.real[outputPos] 
-                                         - iData.real[inputPos])
-                                             / (m_integratedFrameCount - 1));
-
-                rData.imaginary[outputPos] = (float)(((double)m_integratedFrameCount * rData.imaginary[outputPos] 
-                                             - iData.imaginary[inputPos])
-                                                / (m_integratedFrameCount - 1));
-
-			    inputPos += iData.vStep;
-			    outputPos += rData.vStep;
-		    }
-
-		    inputOffset += iData.hStep;
-		    outputOffset += rData.hStep;
-
-		    inputPos = inputOffset;
-		    outputPos = outputOffset;
-	    }
-    }
-    else
-    {
-        for(int iii = 0; iii < iData.hSize; ++iii)
-	    {
-		    for(int jjj = 0; jjj < iData.vSize; ++jjj)
-		    {
-                rData.real[outputPos] = (float)(((double)m_integratedFrameCount * rData.real[outputPos] 
-                                         - iData.real[inputPos])
-                                             / (m_integratedFrameCount - 1));
-
-			    inputPos += iData.vStep;
-			    outputPos += rData.vStep;
-		    }
-
-		    inputOffset += iData.hStep;
-		    outputOffset += rData.hStep;
-
-		    inputPos = inputOffset;
-		    outputPos = outputOffset;
-	    }
-    }
+	for(int jjj = 0; jjj < iData.vSize; ++jjj)
+	{
+        emd::AccumulateKernel<T>::run(iData.real + jjj * iData.vStep,
+                                      rData.real + jjj * rData.vStep,
+                                      iData.hSize, keep, -scale);
+
+        if(frame->isComplex())
+        {
+            emd::AccumulateKernel<T>::run(iData.imaginary + jjj * iData.vStep,
+                                          rData.imaginary + jjj * rData.vStep,
+                                          iData.hSize, keep, -scale);
+        }
+	}
         
     --m_integratedFrameCount;
 }
@@ -27,8 +27,7 @@ namespace emd
 
 BinaryExport::BinaryExport(QObject *parent)
     : ExportOperation(parent),
-    m_outputModule(nullptr),
-    m_exportData(nullptr)
+    m_outputModule(nullptr)
 {
 
 }
@@ -37,9 +36,6 @@ BinaryExport::~BinaryExport()
 {
     if(m_outputModule)
         delete m_outputModule;
-
-    if(m_exportData)
-        delete[] m_exportData;
 }
 
 BinaryOutputModule *BinaryExport::outputModule() const
@@ -56,22 +52,8 @@ void BinaryExport::setOutputModule(BinaryOutputModule *module)
 
 void BinaryExport::doFinish()
 {
-    if(m_outputModule->outputMode() == BinaryOutputModule::OutputModeGrouped)
-    {
-        QFile file(QString(m_outputDirectory % "/" % m_fileStem % "%1").arg(m_fileSuffix));
-        file.open(QIODevice::WriteOnly);
-
-        if(!file.isOpen())
-        {
-            qCritical() << "Failed to open export file.";
-        }
-        else
-        {
-            QDataStream stream(&file);
-
-            stream.writeRawData((char *) m_exportData, m_exportDataLength);
-        }
-    }
+    if(m_exportFile.isOpen())
+        m_exportFile.close();
 }
 
 void BinaryExport::saveFrameData(Frame *frame)
@@ -88,32 +70,28 @@ void BinaryExport::saveFrameData(Frame *frame)
     }
     else if(m_outputModule->outputMode() == BinaryOutputModule::OutputModeGrouped)
     {
-        // On the first frame, initialize the output data vector.
+        // On the first frame, open the output file. The frames arrive in
+        // order and are appended, so the export never holds more than the
+        // frames of one run in memory.
         if(m_exportIndex == 0)
         {
-            m_exportDataLength = m_itemCount * emdTypeDepth(m_outputModule->outputType());
+            m_exportFile.setFileName(QString(m_outputDirectory % "/" % m_fileStem % "%1").arg(m_fileSuffix));
 
-            if(frame->isComplex())
-                m_exportDataLength *= 2;
-
-            m_exportData = (void*) new char[m_exportDataLength];
+            if(!m_exportFile.open(QIODevice::WriteOnly))
+                qCritical() << "Failed to open export file.";
         }
 
-        Frame::Data<char> frameData = frame->data<char>();
-
-        int frameSize = frameData.hSize * frameData.vSize * emdTypeDepth(frame->dataType());
-
-        int complexCorrection = 1;
-        if(frameData.imaginary)
-            complexCorrection = 2;
+        if(m_exportFile.isOpen())
+        {
+            Frame::Data<char> frameData = frame->data<char>();
 
-        // TODO: better way to handle the frame index? e.g. start at zero
-        int64_t offset = m_exportIndex * frameSize * complexCorrection;
+            int64_t frameSize = (int64_t) frameData.hSize * frameData.vSize * emdTypeDepth(frame->dataType());
 
-        memcpy(((char*)m_exportData + offset), frameData.real, frameSize);
+            m_exportFile.write(frameData.real, frameSize);
 
-        if(frameData.imaginary)
-            memcpy(((char*)m_exportData + offset + frameSize), frameData.imaginary, frameSize);
+            if(frameData.imaginary)
+                m_exportFile.write(frameData.imaginary, frameSize);
+        }
 
      //   bool descendingData = m_modelManager.currentModel()->currentDataGroup()->data()->dataOrder();
      //   int complexIndex = m_modelManager.currentModel()->currentDataGroup()->data()->complexIndex();
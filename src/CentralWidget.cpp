@@ -33,6 +33,7 @@
 #include "DataGroupModule.h"
 #include "DimensionsPane.h"
 #include "ExportOperation.h"
+#include "FramePrefetcher.h"
 #include "HistogramModule.h"
 #include "ImageExport.h"
 #include "ImageWindowModule.h"
@@ -53,7 +54,8 @@ CentralWidget::CentralWidget(QWidget *parent)
     m_axesLocked(true),
     m_workflow(nullptr),
     m_exportOperation(nullptr),
-    m_histogramModule(nullptr)
+    m_histogramModule(nullptr),
+    m_prefetcher(nullptr)
 {
     m_imageWidget = new MainGraphicsImageWidget();
     connect(m_imageWidget, SIGNAL(cursorPositionChanged(float, float)),
@@ -326,6 +328,11 @@ CentralWidget::~CentralWidget()
 {
     if(m_workflow)
         delete m_workflow;
+
+    // Like the workflow's modules, it may still have a job on the workers,
+    // which is waited for before the data group can be unloaded
+    if(m_prefetcher)
+        delete m_prefetcher;
 }
 
 void CentralWidget::reset(DataGroup *dataGroup)
@@ -345,6 +352,14 @@ void CentralWidget::reset(DataGroup *dataGroup)
     m_dimensionsPane->reset(m_dataGroup);
     m_dimensionsPane->setMinimumSize(m_dimensionsPane->minimumSizeHint());
 
+    if(m_prefetcher)
+        delete m_prefetcher;
+
+    m_prefetcher = new FramePrefetcher(m_dataGroup);
+    m_prefetcher->updateSelection(m_dimensionsPane->selection());
+    connect(m_dimensionsPane, SIGNAL(selectionChanged(const FrameSet::Selection &)),
+        m_prefetcher, SLOT(updateSelection(const FrameSet::Selection &)));
+
     // Update image labels
     m_imageUnitsLabel->setText(m_dataGroup->data()->units());
     
@@ -25,6 +25,7 @@
 #include <qfiledialog.h>
 #include <qlistwidget.h>
 #include <qmenu.h>
+#include <QMutexLocker>
 #include <qpushbutton.h>
 #include <qtimer.h>
 #include <qtreeview.h>
@@ -32,6 +33,7 @@
 
 #include "Attribute.h"
 #include "FileManager.h"
+#include "FrameCache.h"
 #include "MessageModel.h"
 #include "Model.h"
 #include "ModelManager.h"
@@ -230,7 +232,13 @@ void FileBrowser::openFile(const QString &path)
 
 	// Attempt to load the image
 	Model *emdModel = new Model();
-	bool success = emdModel->open(path);
+	bool success;
+
+    {
+        // Workers may be reading other files through HDF5
+        QMutexLocker locker(&FrameCache::readMutex());
+        success = emdModel->open(path);
+    }
 
 	if(success)
 	{
@@ -254,6 +262,8 @@ void FileBrowser::openFile(const QString &path)
 	else
 	{
 		qWarning() << "File open failed.";
+
+        QMutexLocker locker(&FrameCache::readMutex());
 		delete emdModel;
 	}
 }
@@ -339,6 +349,7 @@ void FileBrowser::saveFile()
 
 	qDebug() << "Attempting to save file: " << filePath;	
 
+    QMutexLocker locker(&FrameCache::readMutex());
 	emdModel->save(filePath);
 }
 
@@ -369,6 +380,8 @@ void FileBrowser::saveFileAs()
 	qDebug() << "Attempting to save file: " << fileName;	
 
 	emdModel->setDirty();
+
+    QMutexLocker locker(&FrameCache::readMutex());
 	emdModel->save(fileName);
 }
 
@@ -391,14 +404,22 @@ void FileBrowser::importFile()
 
 	Model *emdModel = new Model();
 
-    emd::FileManager::Error error = emd::FileManager::openFile(filePath.toUtf8(), emdModel);
+    emd::FileManager::Error error;
+
+    {
+        QMutexLocker locker(&FrameCache::readMutex());
+        error = emd::FileManager::openFile(filePath.toUtf8(), emdModel);
+    }
 
 	if(error == emd::FileManager::ErrorNone)
 	{
         emdModel->setFilePath(filePath);
 
         // TODO: not the right place for this.
-        emdModel->validateDataGroups();
+        {
+            QMutexLocker locker(&FrameCache::readMutex());
+            emdModel->validateDataGroups();
+        }
 
         m_modelManager->addModel(emdModel, true);
 
@@ -412,6 +433,7 @@ void FileBrowser::importFile()
 	}
 	else
 	{
+        QMutexLocker locker(&FrameCache::readMutex());
 		if(emdModel)
 			delete emdModel;
 	}
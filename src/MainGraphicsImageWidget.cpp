@@ -27,6 +27,7 @@
 #include "GraphicsImageItem.h"
 #include "MainImageScene.h"
 #include "MainImageView.h"
+#include "Trace.h"
 
 #include "PointCloud.h"
 
@@ -108,6 +109,8 @@ MainGraphicsImageWidget::MainGraphicsImageWidget(QWidget *parent)
 
 void MainGraphicsImageWidget::update()
 {
+	EMD_TRACE_ZONE("MainGraphicsImageWidget::update");
+
 	if(!m_currentImage)
 		return;
 
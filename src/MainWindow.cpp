@@ -30,6 +30,7 @@
 #include "FileBrowser.h"
 #include "FileExporter.h"
 #include "FileManager.h"
+#include "FrameCache.h"
 #include "Frame.h"
 #include "HistogramModule.h"
 #include "ImageWindowModule.h"
@@ -39,6 +40,7 @@
 #include "Plugin.h"
 #include "PreferencesDialog.h"
 #include "StatusLabel.h"
+#include "Trace.h"
 #include "Workflow.h"
 #include "WorkflowBrowser.h"
 
@@ -57,6 +59,8 @@ static const QString kProgramVersion = "Beta 0.4";
 
 static const QSize defaultWindowSize(1200, 600);
 
+static const int kCacheStatusInterval = 1000;  // ms
+
 MainWindow::MainWindow() : 
     QMainWindow(),
     m_workflowControlWidget(nullptr),
@@ -209,6 +213,11 @@ void MainWindow::setUpUI()
 	connect(printWorkflowAction, SIGNAL(triggered()),
 		this, SLOT(printCurrentWorkflow()));
 
+    QAction *saveTraceAction = m_debugMenu->addAction("Save Trace...");
+    saveTraceAction->setEnabled(Trace::enabled());
+    connect(saveTraceAction, SIGNAL(triggered()),
+        this, SLOT(saveTrace()));
+
     QAction *printModelsAction = m_debugMenu->addAction("Print Models");
     connect(printModelsAction, SIGNAL(triggered()),
         this, SLOT(printModels()));
@@ -312,6 +321,15 @@ void MainWindow::setUpUI()
     m_tempStatusLabel = new QLabel();
     m_tempStatusLabel->setSizePolicy(QSizePolicy::MinimumExpanding, QSizePolicy::Maximum);
 
+    m_cacheStatusLabel = new QLabel();
+    m_cacheStatusLabel->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Maximum);
+
+    QTimer *cacheStatusTimer = new QTimer(this);
+    connect(cacheStatusTimer, SIGNAL(timeout()),
+        this, SLOT(updateCacheStatus()));
+    cacheStatusTimer->start(kCacheStatusInterval);
+    updateCacheStatus();
+
 	m_progressBar = new QProgressBar();
 	m_progressBar->setTextVisible(false);
     m_progressBar->setMinimumWidth(300);
@@ -320,6 +338,7 @@ void MainWindow::setUpUI()
     QHBoxLayout *statusBarLayout = new QHBoxLayout();
     statusBarLayout->addWidget(m_statusSpacerWidget, 4);
     statusBarLayout->addWidget(m_tempStatusLabel, 3, Qt::AlignLeft);
+    statusBarLayout->addWidget(m_cacheStatusLabel, 0, Qt::AlignRight);
     statusBarLayout->addWidget(m_progressBar, 2, Qt::AlignRight);
     statusBarLayout->setContentsMargins(0, 0, 10, 0);
 
@@ -499,6 +518,34 @@ void MainWindow::displayTempMessage(const QString &msg)
     m_tempStatusLabel->update();
 }
 
+void MainWindow::updateCacheStatus()
+{
+    FrameCache::Statistics statistics = FrameCache::instance().statistics();
+
+    const double megabyte = 1024. * 1024.;
+
+    m_cacheStatusLabel->setText(QString("Cache: %1 / %2 MB")
+        .arg(statistics.bytes / megabyte, 0, 'f', 0)
+        .arg(statistics.budget / megabyte, 0, 'f', 0));
+
+    QString toolTip = QString("%1 frames cached\n"
+        "%2 hits, %3 misses, %4 evicted")
+        .arg(statistics.frameCount)
+        .arg(statistics.hits)
+        .arg(statistics.misses)
+        .arg(statistics.evictions);
+
+    int64_t chunkReads = statistics.chunkHits + statistics.chunkMisses;
+    if(chunkReads > 0)
+    {
+        toolTip += QString("\nChunk reuse: %1% of %2 reads")
+            .arg(100. * statistics.chunkHits / chunkReads, 0, 'f', 0)
+            .arg(chunkReads);
+    }
+
+    m_cacheStatusLabel->setToolTip(toolTip);
+}
+
 void MainWindow::changeWorkflowControlVisibility(bool visible)
 {
 	m_workflowControlAction->setChecked(visible);
@@ -608,11 +655,15 @@ void MainWindow::closeDataGroup(DataGroup *dataGroup)
     int tabIndex;
     CentralWidget *centralWidget = this->widgetForDataGroup(dataGroup, &tabIndex);
 
+    // Deleting the widget waits for its workflow's reads of the dataset
     if(centralWidget)
     {
         m_centralTabWidget->removeTab(tabIndex);
         delete centralWidget;
     }
+
+    // The dataset is about to be unloaded
+    FrameCache::instance().remove(dataGroup->data());
 }
 
 /******************************* File Operations *****************************/
@@ -845,6 +896,20 @@ void MainWindow::printModels() const
     m_modelManager.print();
 }
 
+void MainWindow::saveTrace()
+{
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Trace"),
+        "trace.json", tr("Chrome Trace (*.json)"));
+
+    if(path.isEmpty())
+        return;
+
+    if(Trace::save(path))
+        qDebug() << "Saved trace to" << path;
+    else
+        qWarning() << "Failed to save trace to" << path;
+}
+
 void MainWindow::resizeEvent(QResizeEvent *)
 {
     m_messageView->setFixedWidth(m_statusSpacerWidget->width());
@@ -24,11 +24,14 @@
 #include <QApplication>
 #include <qboxlayout.h>
 #include <qdialog.h>
+#include <QMutexLocker>
 #include <qlineedit.h>
 #include <qpushbutton.h>
 
 #include "Attribute.h"
 #include "DataTypeBox.h"
+#include "DatasetStorage.h"
+#include "FrameCache.h"
 #include "Model.h"
 
 namespace emd
@@ -43,6 +46,7 @@ ModelManager::ModelManager()
 
 ModelManager::~ModelManager()
 {
+    QMutexLocker locker(&FrameCache::readMutex());
     qDeleteAll(m_models);
 }
 
@@ -72,6 +76,8 @@ void ModelManager::removeModel(Model *model)
     m_models.removeAt(index);
     endRemoveRows();
 
+    // The model's widgets, and so their reads, went with closeModel()
+    QMutexLocker locker(&FrameCache::readMutex());
     delete model;
 }
 
@@ -102,13 +108,22 @@ void ModelManager::displayDataGroup(Model *model, int dataGroupIndex)
 
     if(!model->dataGroupAtIndex(dataGroupIndex)->isLoaded())
     {
-        bool success = model->loadDataGroup(dataGroupIndex);
+        bool success;
+
+        {
+            // Workers may be reading other data groups through HDF5
+            QMutexLocker locker(&FrameCache::readMutex());
+            success = model->loadDataGroup(dataGroupIndex);
+        }
 
         if(!success)
         {
             qDebug() << "Failed to load data group at index: " << dataGroupIndex;
             return;
         }
+
+        DatasetStorage::attach(model->dataGroupAtIndex(dataGroupIndex));
+        FrameCache::instance().tuneChunkCache(model->dataGroupAtIndex(dataGroupIndex));
     }
 
     QModelIndex modelIndex = this->index(m_models.indexOf(model), 0);
@@ -144,7 +159,12 @@ void ModelManager::closeModel(Model *model)
         }
     }
 
-    model->unloadDataGroups();
+    {
+        // The widgets of the data groups have been deleted by now, but other
+        // files' reads may still be running
+        QMutexLocker locker(&FrameCache::readMutex());
+        model->unloadDataGroups();
+    }
 
     emit(dataChanged(modelIndex, modelIndex, roles));
 }
@@ -373,10 +393,14 @@ void ModelManager::handleAddAttribute()
         QModelIndex parentIndex = createIndex(m_contextMenuNode->rowNumber(), 0, m_contextMenuNode);
         this->beginInsertRows(parentIndex, m_contextMenuNode->childCount(), m_contextMenuNode->childCount());
 
+        QMutexLocker locker(&FrameCache::readMutex());
+
 		Attribute *node = dynamic_cast<Attribute*>(
 			m_contextMenuModel->addNode(name, Node::ATTRIBUTE, m_contextMenuNode));
 		node->setType(type);
 
+        locker.unlock();
+
         this->endInsertRows();
 		
 		QString valueString = valueBox->text();
@@ -547,7 +571,10 @@ bool ModelManager::setData(const QModelIndex &index, const QVariant &value, int
         Model *emdModel = modelForIndex(index);
 
         if(emdModel)
+        {
+            QMutexLocker locker(&FrameCache::readMutex());
             return emdModel->setData(index, value, role);
+        }
     }
 
     return false;
@@ -23,6 +23,9 @@
 #include <QtWidgets>
 
 #include "ColourManager.h"
+#include "DataGroupModule.h"
+#include "FrameCache.h"
+#include "WorkScheduler.h"
 
 namespace emd
 {
@@ -49,6 +52,49 @@ PreferencesDialog::PreferencesDialog(QWidget *parent)
     colourMapLayout->addWidget(m_colourMapBox, 1, 0, 1, 2, Qt::AlignCenter);
     colourMapLayout->addItem(new QSpacerItem(1, 1, QSizePolicy::Maximum), 0, 2, 2, 1);
 
+    m_threadCountBox = new QSpinBox();
+    m_threadCountBox->setRange(0, 256);
+    m_threadCountBox->setSpecialValueText(QString("Automatic (%1)").arg(WorkScheduler::idealThreadCount()));
+
+    if(WorkScheduler::environmentThreadCount() > 0)
+    {
+        m_threadCountBox->setEnabled(false);
+        m_threadCountBox->setToolTip("Overridden by the EMD_WORKER_THREADS environment variable.");
+    }
+
+    QLabel *threadCountTitle = new QLabel("Worker Threads:");
+
+    QHBoxLayout *threadCountLayout = new QHBoxLayout();
+    threadCountLayout->addWidget(threadCountTitle, 0, Qt::AlignRight);
+    threadCountLayout->addWidget(m_threadCountBox, 0, Qt::AlignLeft);
+    threadCountLayout->addStretch();
+
+    m_cacheSizeBox = new QSpinBox();
+    m_cacheSizeBox->setRange(0, 1024 * 1024);
+    m_cacheSizeBox->setSingleStep(128);
+    m_cacheSizeBox->setSuffix(" MB");
+    m_cacheSizeBox->setSpecialValueText("Disabled");
+
+    QLabel *cacheSizeTitle = new QLabel("Frame Cache:");
+
+    QHBoxLayout *cacheSizeLayout = new QHBoxLayout();
+    cacheSizeLayout->addWidget(cacheSizeTitle, 0, Qt::AlignRight);
+    cacheSizeLayout->addWidget(m_cacheSizeBox, 0, Qt::AlignLeft);
+    cacheSizeLayout->addStretch();
+
+    m_streamingLimitBox = new QSpinBox();
+    m_streamingLimitBox->setRange(0, 1024 * 1024);
+    m_streamingLimitBox->setSingleStep(256);
+    m_streamingLimitBox->setSuffix(" MB");
+    m_streamingLimitBox->setSpecialValueText("Disabled");
+    m_streamingLimitBox->setToolTip("Larger selections are read and processed in parts.");
+
+    QLabel *streamingLimitTitle = new QLabel("Streaming Limit:");
+
+    QHBoxLayout *streamingLimitLayout = new QHBoxLayout();
+    streamingLimitLayout->addWidget(streamingLimitTitle, 0, Qt::AlignRight);
+    streamingLimitLayout->addWidget(m_streamingLimitBox, 0, Qt::AlignLeft);
+    streamingLimitLayout->addStretch();
 
     QPushButton *cancelButton = new QPushButton("Cancel");
     connect(cancelButton, SIGNAL(clicked()),
@@ -70,6 +116,9 @@ PreferencesDialog::PreferencesDialog(QWidget *parent)
 
     QVBoxLayout *layout = new QVBoxLayout();
     layout->addLayout(colourMapLayout);
+    layout->addLayout(threadCountLayout);
+    layout->addLayout(cacheSizeLayout);
+    layout->addLayout(streamingLimitLayout);
     layout->addStretch();
     layout->addWidget(buttonGroup);
 
@@ -84,6 +133,16 @@ void PreferencesDialog::loadSettings()
 
     m_colourMapBox->setCurrentIndex(ColourManager::instance().indexOf(defaultMap));
     m_colourMapLabel->setText(defaultMap.name());
+
+    QSettings settings;
+
+    if(WorkScheduler::environmentThreadCount() > 0)
+        m_threadCountBox->setValue(WorkScheduler::instance().threadCount());
+    else
+        m_threadCountBox->setValue(settings.value("Preferences/WorkerThreadCount", 0).toInt());
+
+    m_cacheSizeBox->setValue((int) (FrameCache::instance().budget() / (1024 * 1024)));
+    m_streamingLimitBox->setValue((int) (DataGroupModule::streamingLimit() / (1024 * 1024)));
 }
 
 void PreferencesDialog::saveSettings()
@@ -92,6 +151,21 @@ void PreferencesDialog::saveSettings()
 
     ColourMap defaultMap = ColourManager::instance().colourMap(m_colourMapBox->currentIndex());
     settings.setValue("Preferences/DefaultColourMap", defaultMap.name());
+
+    if(WorkScheduler::environmentThreadCount() == 0)
+    {
+        settings.setValue("Preferences/WorkerThreadCount", m_threadCountBox->value());
+
+        WorkScheduler::instance().setThreadCount(m_threadCountBox->value());
+    }
+
+    settings.setValue("Preferences/FrameCacheSize", m_cacheSizeBox->value());
+
+    FrameCache::instance().setBudget((int64_t) m_cacheSizeBox->value() * 1024 * 1024);
+
+    settings.setValue("Preferences/StreamingLimit", m_streamingLimitBox->value());
+
+    DataGroupModule::setStreamingLimit((int64_t) m_streamingLimitBox->value() * 1024 * 1024);
 }
 
 void PreferencesDialog::cancel()